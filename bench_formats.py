@@ -0,0 +1,52 @@
+# Compares the json, cbor and msgpack outputs of get_json/get_assembly:
+# time to produce them, time to load them in Python and their size.
+# cbor and msgpack loading needs the cbor2 and msgpack packages.
+#
+# python3 bench_formats.py ./test [more binaries...]
+
+import json
+import sys
+import time
+
+import simpleoptparser as sopt
+
+try:
+    import cbor2
+except ImportError:
+    cbor2 = None
+
+try:
+    import msgpack
+except ImportError:
+    msgpack = None
+
+loaders = {
+    "json": json.loads,
+    "cbor": cbor2.loads if cbor2 else None,
+    "msgpack": (lambda b: msgpack.unpackb(b, strict_map_key=False)) if msgpack else None,
+}
+
+
+def bench(getter, fmt, repeat=5):
+    encode = decode = float("inf")
+    for _ in range(repeat):
+        start = time.perf_counter()
+        out = getter(format=fmt)
+        encode = min(encode, time.perf_counter() - start)
+
+        if loaders[fmt]:
+            start = time.perf_counter()
+            loaders[fmt](out)
+            decode = min(decode, time.perf_counter() - start)
+    return encode, decode, len(out)
+
+
+for binary in sys.argv[1:] or ["./test"]:
+    sopt.decode(binary)
+    for name, getter in (("get_json", sopt.get_json), ("get_assembly", sopt.get_assembly)):
+        print("%s %s" % (binary, name))
+        print("  %-8s %12s %12s %12s" % ("format", "encode (ms)", "decode (ms)", "size (B)"))
+        for fmt in ("json", "cbor", "msgpack"):
+            encode, decode, size = bench(getter, fmt)
+            decode_str = "%12.3f" % (decode * 1000) if decode != float("inf") else "%12s" % "n/a"
+            print("  %-8s %12.3f %s %12d" % (fmt, encode * 1000, decode_str, size))
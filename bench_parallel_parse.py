@@ -0,0 +1,34 @@
+# Times get_json, whose per-function entries are built on `threads` threads,
+# for thread counts up to 64 and checks every run matches the 1 thread output.
+#
+# python3 bench_parallel_parse.py ./test [more binaries...]
+
+import sys
+import time
+
+import simpleoptparser as sopt
+
+THREADS = (1, 2, 4, 8, 16, 32, 64)
+
+
+def bench(fmt, compact, repeat=3):
+    best = float("inf")
+    for _ in range(repeat):
+        start = time.perf_counter()
+        out = sopt.get_json(format=fmt, compact=compact)
+        best = min(best, time.perf_counter() - start)
+    return best, out
+
+
+for binary in sys.argv[1:] or ["./test"]:
+    for fmt, compact in (("json", False), ("json", True), ("cbor", False)):
+        print("%s format=%s compact=%s" % (binary, fmt, compact))
+        print("  %-8s %12s %10s %10s" % ("threads", "time (ms)", "speedup", "identical"))
+        serial = None
+        for threads in THREADS:
+            sopt.decode(binary, threads=threads)
+            seconds, out = bench(fmt, compact)
+            if serial is None:
+                serial = (seconds, out)
+            print("  %-8d %12.3f %10.2f %10s" % (threads, seconds * 1000,
+                                                 serial[0] / seconds, out == serial[1]))
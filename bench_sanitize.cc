@@ -0,0 +1,79 @@
+// Compares clean_string() and interned_clean_string() against the regex
+// based sanitizer they replaced, on long C++ template names. Each name is
+// cleaned many times, the way writeDOT and getAssembly clean the function
+// name once per block.
+//
+// make bench_sanitize && ./bench_sanitize
+
+#include <chrono>
+#include <iostream>
+#include <regex>
+#include <string>
+#include <vector>
+
+#include "sanitize.h"
+
+using namespace std;
+
+string regex_clean_string(const string &str) {
+  static regex pattern("[^a-zA-Z0-9 /:;,\\.{}\\[\\]<>~|\\-_+()&\\*=$!#]");
+  const size_t len = str.length();
+  string str2;
+  if (len > MAX_NAME_LENGTH) {
+    size_t substrlen = (MAX_NAME_LENGTH - 3) / 2;
+    str2 = str.substr(0, substrlen) + "..." + str.substr(len - substrlen);
+  } else {
+    str2 = str;
+  }
+  return regex_replace(str2, pattern, "?");
+}
+
+vector<string> templateNames(int count) {
+  vector<string> names;
+  for (int i = 0; i < count; i++) {
+    string name = "std::_Rb_tree<std::__cxx11::basic_string<char, std::char_traits<char>, "
+                  "std::allocator<char> >, std::pair<std::__cxx11::basic_string<char> const, "
+                  "std::vector<ns" + to_string(i) + "::Node<" + to_string(i) +
+                  ">*, std::allocator<ns::Node*> > >, std::_Select1st<...> >::_M_insert_unique"
+                  "(std::pair<...>&&) [clone .isra.0] \"quoted\" @plt";
+    names.push_back(name);
+  }
+  return names;
+}
+
+template <typename F>
+double timeIt(const vector<string> &names, int repeat, F clean) {
+  size_t total = 0;
+  auto start = chrono::steady_clock::now();
+  for (int r = 0; r < repeat; r++)
+    for (auto &name : names) total += clean(name).size();
+  double secs = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+  if (total == 0) cerr << "empty output" << endl;
+  return secs;
+}
+
+int main() {
+  const int count = 1000;
+  const int repeat = 50;
+  vector<string> names = templateNames(count);
+
+  for (auto &name : names) {
+    if (regex_clean_string(name) != clean_string(name)) {
+      cerr << "mismatch for " << name << endl;
+      return 1;
+    }
+  }
+
+  double regex_secs = timeIt(names, repeat, regex_clean_string);
+  double table_secs = timeIt(names, repeat, clean_string);
+  double interned_secs = timeIt(names, repeat, interned_clean_string);
+
+  size_t calls = (size_t)count * repeat;
+  cout << calls << " names of " << names[0].size() << "+ bytes" << endl;
+  cout << "regex:    " << regex_secs * 1e9 / calls << " ns/name" << endl;
+  cout << "table:    " << table_secs * 1e9 / calls << " ns/name ("
+       << regex_secs / table_secs << "x)" << endl;
+  cout << "interned: " << interned_secs * 1e9 / calls << " ns/name ("
+       << regex_secs / interned_secs << "x)" << endl;
+  return 0;
+}
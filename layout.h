@@ -0,0 +1,267 @@
+#ifndef LAYOUT
+#define LAYOUT
+
+
+#include <algorithm>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+#define LAYOUT_NODE_GAP 20.0     // horizontal space between nodes of a layer
+#define LAYOUT_LAYER_GAP 40.0    // vertical space between layers
+#define LAYOUT_SWEEPS 4          // barycenter passes, each down then up
+#define LAYOUT_ALIGN_PASSES 4    // passes centering nodes over their neighbours
+#define LAYOUT_DUMMY_BUDGET 4    // dummy nodes allowed per node and edge of the graph
+
+typedef std::pair<double, double> LayoutPoint;
+
+// A directed graph to lay out. Edges marked back are laid out as if they
+// pointed the other way, which is how loop back edges should be drawn.
+struct LayoutGraph {
+  std::vector<double> width;
+  std::vector<double> height;
+  std::vector<std::pair<uint32_t, uint32_t> > edges;
+  std::vector<bool> back;
+};
+
+struct Layout {
+  std::vector<double> x;  // top left corner of each node
+  std::vector<double> y;
+  std::vector<uint32_t> layer;
+  std::vector<std::vector<LayoutPoint> > points;  // per edge, source to target
+  std::vector<bool> back;  // the given back edges plus any cut to break cycles
+};
+
+// Layered (Sugiyama style) layout: back edges reversed to get an acyclic
+// graph, longest path layering pulled down towards successors, dummy nodes
+// along edges spanning several layers, barycenter ordering against
+// crossings, then coordinates. Edges flow downwards; a reversed edge's
+// polyline still runs source to target.
+//
+// Dummy nodes are capped at LAYOUT_DUMMY_BUDGET * (nodes + edges), handed
+// to the shortest edges first. An edge left without them is drawn straight
+// from its tail to its head and takes no part in the ordering, so a few very
+// long edges cannot blow up the size of the layout.
+inline Layout layoutGraph(const LayoutGraph &g) {
+  const uint32_t n = g.width.size();
+  const size_t m = g.edges.size();
+  Layout res;
+  res.back = g.back;
+  res.back.resize(m, false);
+
+  auto tail = [&](size_t e) { return res.back[e] ? g.edges[e].second : g.edges[e].first; };
+  auto head = [&](size_t e) { return res.back[e] ? g.edges[e].first : g.edges[e].second; };
+
+  // Cut the cycles the given back edges leave (irreducible loops): every
+  // edge a depth first search finds into a node still on its path is
+  // reversed as well
+  std::vector<std::vector<size_t> > out(n);
+  for (size_t e = 0; e < m; e++)
+    if (g.edges[e].first != g.edges[e].second) out[tail(e)].push_back(e);
+
+  std::vector<uint8_t> state(n, 0);  // 0 new, 1 on the path, 2 done
+  std::vector<std::pair<uint32_t, size_t> > walk;
+  for (uint32_t root = 0; root < n; root++) {
+    if (state[root]) continue;
+    state[root] = 1;
+    walk.push_back(std::make_pair(root, 0));
+    while (!walk.empty()) {
+      uint32_t v = walk.back().first;
+      size_t &i = walk.back().second;
+      if (i == out[v].size()) {
+        state[v] = 2;
+        walk.pop_back();
+        continue;
+      }
+      size_t e = out[v][i++];
+      uint32_t w = head(e);
+      if (state[w] == 1)
+        res.back[e] = !res.back[e];
+      else if (state[w] == 0) {
+        state[w] = 1;
+        walk.push_back(std::make_pair(w, 0));
+      }
+    }
+  }
+
+  // Longest path layering, in topological order
+  std::vector<std::vector<size_t> > down(n);
+  std::vector<uint32_t> indegree(n, 0);
+  for (size_t e = 0; e < m; e++) {
+    if (g.edges[e].first == g.edges[e].second) continue;
+    down[tail(e)].push_back(e);
+    indegree[head(e)]++;
+  }
+  std::vector<uint32_t> topo;
+  for (uint32_t v = 0; v < n; v++)
+    if (indegree[v] == 0) topo.push_back(v);
+  res.layer.assign(n, 0);
+  std::vector<uint32_t> ins(n, 0);
+  for (size_t i = 0; i < topo.size(); i++)
+    for (auto &e : down[topo[i]]) {
+      uint32_t w = head(e);
+      res.layer[w] = std::max(res.layer[w], res.layer[topo[i]] + 1);
+      ins[w]++;
+      if (--indegree[w] == 0) topo.push_back(w);
+    }
+
+  // Compaction: longest path layering leaves nodes as high as they can go.
+  // Moving a node down to just above its highest successor shortens its out
+  // edges by as much as it stretches its in edges, which does not add dummy
+  // nodes as long as it has no more in edges than out edges. Successors
+  // come later in topo, so they are settled first.
+  for (size_t i = topo.size(); i-- > 0;) {
+    uint32_t v = topo[i];
+    if (down[v].empty() || ins[v] > down[v].size()) continue;
+    uint32_t below = UINT32_MAX;
+    for (auto &e : down[v]) below = std::min(below, res.layer[head(e)]);
+    res.layer[v] = std::max(res.layer[v], below - 1);
+  }
+
+  // Nodes in topological order start each layer; dummy nodes, one per layer
+  // an edge passes through, follow them
+  uint32_t nlayers = 0;
+  for (uint32_t v = 0; v < n; v++) nlayers = std::max(nlayers, res.layer[v] + 1);
+  std::vector<std::vector<uint32_t> > layers(nlayers);
+  std::vector<uint32_t> layer = res.layer;
+  for (auto &v : topo) layers[layer[v]].push_back(v);
+
+  // Shortest edges get their dummy nodes first, until the budget runs out
+  std::vector<size_t> by_span;
+  for (size_t e = 0; e < m; e++)
+    if (tail(e) != head(e)) by_span.push_back(e);
+  auto span = [&](size_t e) { return layer[head(e)] - layer[tail(e)] - 1; };
+  std::stable_sort(by_span.begin(), by_span.end(),
+                   [&](size_t a, size_t b) { return span(a) < span(b); });
+  std::vector<bool> direct(m, false);
+  size_t budget = LAYOUT_DUMMY_BUDGET * (n + m);
+  for (auto &e : by_span) {
+    if (span(e) > budget)
+      direct[e] = true;
+    else
+      budget -= span(e);
+  }
+
+  std::vector<std::vector<uint32_t> > chain(m);  // tail, dummies, head
+  std::vector<std::vector<uint32_t> > ups(n), downs(n);
+  for (size_t e = 0; e < m; e++) {
+    uint32_t v = tail(e), w = head(e);
+    if (v == w) continue;
+    chain[e].push_back(v);
+    if (direct[e] && layer[w] > layer[v] + 1) {
+      chain[e].push_back(w);
+      continue;
+    }
+    for (uint32_t l = layer[v] + 1; l < layer[w]; l++) {
+      uint32_t d = layer.size();
+      layer.push_back(l);
+      layers[l].push_back(d);
+      ups.push_back(std::vector<uint32_t>());
+      downs.push_back(std::vector<uint32_t>());
+      chain[e].push_back(d);
+    }
+    chain[e].push_back(w);
+    for (size_t i = 1; i < chain[e].size(); i++) {
+      downs[chain[e][i - 1]].push_back(chain[e][i]);
+      ups[chain[e][i]].push_back(chain[e][i - 1]);
+    }
+  }
+  const size_t total = layer.size();
+  auto width = [&](uint32_t v) { return v < n ? g.width[v] : 0.0; };
+
+  // Crossing reduction: order each layer by the mean position of its
+  // neighbours in the layer before it
+  std::vector<double> pos(total), key(total);
+  for (auto &l : layers)
+    for (size_t i = 0; i < l.size(); i++) pos[l[i]] = i;
+  auto sortLayer = [&](std::vector<uint32_t> &l, const std::vector<std::vector<uint32_t> > &adj) {
+    for (auto &v : l) {
+      if (adj[v].empty()) {
+        key[v] = pos[v];
+        continue;
+      }
+      double sum = 0;
+      for (auto &u : adj[v]) sum += pos[u];
+      key[v] = sum / adj[v].size();
+    }
+    std::stable_sort(l.begin(), l.end(), [&](uint32_t a, uint32_t b) { return key[a] < key[b]; });
+    for (size_t i = 0; i < l.size(); i++) pos[l[i]] = i;
+  };
+  for (int s = 0; s < LAYOUT_SWEEPS; s++) {
+    for (uint32_t l = 1; l < nlayers; l++) sortLayer(layers[l], ups);
+    for (uint32_t l = nlayers; l-- > 1;) sortLayer(layers[l - 1], downs);
+  }
+
+  // Horizontal placement: pack each layer, then repeatedly move nodes toward
+  // the mean center of their neighbours, keeping order and spacing
+  std::vector<double> cx(total);
+  for (auto &l : layers) {
+    double x = 0;
+    for (auto &v : l) {
+      cx[v] = x + width(v) / 2;
+      x += width(v) + LAYOUT_NODE_GAP;
+    }
+  }
+  auto alignLayer = [&](const std::vector<uint32_t> &l, const std::vector<std::vector<uint32_t> > &adj) {
+    double left = -1e300;
+    for (auto &v : l) {
+      double want = cx[v];
+      if (!adj[v].empty()) {
+        want = 0;
+        for (auto &u : adj[v]) want += cx[u];
+        want /= adj[v].size();
+      }
+      cx[v] = std::max(want, left + width(v) / 2);
+      left = cx[v] + width(v) / 2 + LAYOUT_NODE_GAP;
+    }
+  };
+  for (int p = 0; p < LAYOUT_ALIGN_PASSES; p++) {
+    for (uint32_t l = 1; l < nlayers; l++) alignLayer(layers[l], ups);
+    for (uint32_t l = nlayers; l-- > 1;) alignLayer(layers[l - 1], downs);
+  }
+  double minx = 0;
+  for (size_t v = 0; v < total; v++) minx = std::min(minx, cx[v] - width(v) / 2);
+  for (auto &c : cx) c -= minx;
+
+  // Layers are as tall as their tallest node, nodes hang from the top
+  std::vector<double> top(nlayers, 0), tall(nlayers, 0);
+  for (uint32_t v = 0; v < n; v++) tall[layer[v]] = std::max(tall[layer[v]], g.height[v]);
+  for (uint32_t l = 1; l < nlayers; l++) top[l] = top[l - 1] + tall[l - 1] + LAYOUT_LAYER_GAP;
+
+  res.x.resize(n);
+  res.y.resize(n);
+  for (uint32_t v = 0; v < n; v++) {
+    res.x[v] = cx[v] - g.width[v] / 2;
+    res.y[v] = top[layer[v]];
+  }
+
+  // Polylines leave the bottom of the upper node, run straight through the
+  // layers of their dummy nodes and enter the top of the lower node
+  res.points.resize(m);
+  for (size_t e = 0; e < m; e++) {
+    std::vector<LayoutPoint> &pts = res.points[e];
+    uint32_t v = g.edges[e].first;
+    if (chain[e].empty()) {
+      // Self loop, drawn on the right side of the node
+      double right = res.x[v] + g.width[v], y = res.y[v];
+      double h = g.height[v];
+      pts.push_back(LayoutPoint(right, y + h / 3));
+      pts.push_back(LayoutPoint(right + LAYOUT_NODE_GAP / 2, y + h / 3));
+      pts.push_back(LayoutPoint(right + LAYOUT_NODE_GAP / 2, y + 2 * h / 3));
+      pts.push_back(LayoutPoint(right, y + 2 * h / 3));
+      continue;
+    }
+    uint32_t first = chain[e].front(), last = chain[e].back();
+    pts.push_back(LayoutPoint(cx[first], res.y[first] + g.height[first]));
+    for (size_t i = 1; i + 1 < chain[e].size(); i++) {
+      uint32_t d = chain[e][i];
+      pts.push_back(LayoutPoint(cx[d], top[layer[d]]));
+      pts.push_back(LayoutPoint(cx[d], top[layer[d]] + tall[layer[d]]));
+    }
+    pts.push_back(LayoutPoint(cx[last], res.y[last]));
+    if (res.back[e]) std::reverse(pts.begin(), pts.end());
+  }
+  return res;
+}
+
+#endif
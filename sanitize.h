@@ -0,0 +1,70 @@
+#ifndef SANITIZE
+#define SANITIZE
+
+
+#include <string>
+#include <unordered_map>
+
+#define MAX_NAME_LENGTH 128
+#define NAME_CACHE_ENTRIES (1 << 16)
+
+// Bytes that are kept by clean_string(), everything else becomes '?'
+struct NameCharTable {
+  bool allowed[256];
+
+  NameCharTable() {
+    static const char extra[] = " /:;,.{}[]<>~|-_+()&*=$!#";
+    for (int c = 0; c < 256; c++)
+      allowed[c] = (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') ||
+                   (c >= '0' && c <= '9');
+    for (const char *c = extra; *c; c++) allowed[(unsigned char)*c] = true;
+  }
+};
+
+// Replaces every byte outside NameCharTable by '?'
+inline void replace_disallowed(std::string &str) {
+  static const NameCharTable table;
+  for (auto &c : str)
+    if (!table.allowed[(unsigned char)c]) c = '?';
+}
+
+// Names longer than MAX_NAME_LENGTH keep their head and tail around "...",
+// and every byte outside NameCharTable is replaced by '?'.
+inline std::string clean_string(const std::string &str) {
+  const size_t len = str.length();
+
+  std::string out;
+  if (len > MAX_NAME_LENGTH) {
+    size_t substrlen = (MAX_NAME_LENGTH - 3) / 2;
+    out.reserve(2 * substrlen + 3);
+    out.append(str, 0, substrlen);
+    out += "...";
+    out.append(str, len - substrlen, substrlen);
+  } else {
+    out = str;
+  }
+
+  replace_disallowed(out);
+  return out;
+}
+
+// File paths are only cleaned, never shortened, so the same path reads the
+// same wherever it is written and the front end can join on it.
+inline std::string clean_path(std::string path) {
+  replace_disallowed(path);
+  return path;
+}
+
+// clean_string() memoized per thread. The same function and file names are
+// cleaned for every block and line, so most calls are a single lookup. The
+// table starts over once it holds NAME_CACHE_ENTRIES names.
+inline std::string interned_clean_string(const std::string &str) {
+  static thread_local std::unordered_map<std::string, std::string> table;
+
+  auto found = table.find(str);
+  if (found != table.end()) return found->second;
+  if (table.size() >= NAME_CACHE_ENTRIES) table.clear();
+  return table.emplace(str, clean_string(str)).first->second;
+}
+
+#endif
@@ -16,8 +16,9 @@ def main():
                 sources=["simpleopt_wrapper.cc", "simpleopt.cc"],
                 include_dirs=["/dyninst/install/include", "/root/simple-optparser/includes", "/usr/include"],
                 library_dirs=["/dyninst/install/lib"],
-                libraries=["symtabAPI", "parseAPI", "instructionAPI", "dynDwarf", "dynElf", "common", "elf"],
-                extra_compile_args=["-std=c++0x"],
+                libraries=["symtabAPI", "parseAPI", "instructionAPI", "dynDwarf", "dynElf", "common", "elf", "z", "zstd"],
+                extra_compile_args=["-std=c++0x", "-pthread", "-fopenmp"],
+                extra_link_args=["-pthread", "-fopenmp"],
                 language="c++",
             )
         ]
@@ -1,6 +1,13 @@
 #include "simpleopt.h"
 
-#define MAX_NAME_LENGTH 128
+#define SCAN_CHUNK_SIZE 64
+#define CACHE_FORMAT_VERSION 5
+#define PRINT_CHUNK_SIZE 4
+#define PRINT_WINDOW 1024
+#define COMPRESS_QUEUE_DEPTH 4
+#define LAYOUT_CHAR_WIDTH 7.0
+#define LAYOUT_LINE_HEIGHT 14.0
+#define LAYOUT_PADDING 8.0
 
 using namespace std;
 using namespace Dyninst;
@@ -10,9 +17,36 @@ using namespace InstructionAPI;
 
 using json = nlohmann::json;
 
+typedef enum {
+  fmt_json,
+  fmt_cbor,
+  fmt_msgpack
+} output_format;
+
 // Arguements
 string binaryPath;
 vector<string> functionNames;
+// -1 when no thread count was given: the scan and output run serially and
+// the parse keeps the OpenMP runtime's default team
+int numThreads = -1;
+bool targetedParse = false;
+int callDepth = 0;
+string cacheDir;
+output_format outputFormat = fmt_json;
+bool compactNames = false;
+bool integerBlockIds = false;
+compression outputCompression = comp_none;
+bool dotClusters = false;
+bool callGraphOutput = false;
+bool collapseBlocks = false;
+bool layoutOutput = false;
+string dotFunction;  // name or entry address given with --dot-function
+size_t pageOffset = 0;
+size_t pageLimit = 0;   // 0 means no limit
+PageCursor pageCursor;  // from --after
+bool listFunctionsOnly = false;
+vector<Dyninst::Address> entryAddresses;
+vector<Dyninst::Address> lookupAddrs;
 
 typedef enum {
   bb_vectorized,
@@ -23,22 +57,548 @@ typedef enum {
   bb_fp
 } block_flags;
 
+// Bit i is set when the block has block_flags value i
+typedef uint8_t block_flag_set;
+
+// Instructions decoded by decode(), kept so the exporters do not have to
+// disassemble the binary again. Texts live back to back in one NUL separated
+// pool. Addresses are not stored: the rows of a block are its instructions in
+// order, so each one starts where the one before it ends (see insnStarts()).
+struct InsnTable {
+  vector<uint8_t> length;
+  vector<uint8_t> category;
+  vector<size_t> text;  // offset into texts
+  vector<char> texts;
+
+  size_t size() const { return length.size(); }
+
+  void push(const Instruction &instr) {
+    length.push_back(instr.size());
+    category.push_back(instr.getCategory());
+    text.push_back(texts.size());
+    string formatted = instr.format();
+    texts.insert(texts.end(), formatted.begin(), formatted.end());
+    texts.push_back('\0');
+  }
+
+  // Copies count rows of other starting at begin to the end of this table
+  void append(const InsnTable &other, size_t begin, size_t count) {
+    if (count == 0) return;
+    size_t text_begin = other.text[begin];
+    size_t text_end = begin + count < other.size() ? other.text[begin + count]
+                                                   : other.texts.size();
+    size_t shift = texts.size() - text_begin;
+    length.insert(length.end(), other.length.begin() + begin, other.length.begin() + begin + count);
+    category.insert(category.end(), other.category.begin() + begin, other.category.begin() + begin + count);
+    for (size_t i = begin; i < begin + count; i++)
+      text.push_back(other.text[i] + shift);
+    texts.insert(texts.end(), other.texts.begin() + text_begin, other.texts.begin() + text_end);
+  }
+
+  const char *textOf(size_t i) const { return &texts[text[i]]; }
+
+  void clear() {
+    length.clear();
+    category.clear();
+    text.clear();
+    texts.clear();
+  }
+};
+
+// Every distinct block seen by decode(), stored as parallel arrays indexed by
+// a dense block index. Names live back to back in one NUL separated pool.
+struct BlockTable {
+  static const uint32_t npos = (uint32_t)-1;
+
+  vector<Block *> block;
+  vector<Address> start;
+  vector<Address> end;
+  vector<block_flag_set> flags;
+  vector<uint32_t> func;  // row of function_table
+  vector<size_t> name;    // offset into names
+  vector<uint32_t> number;  // n of the "<function>: B<n>" name
+  vector<size_t> insn;    // first row in insn_table
+  vector<uint32_t> ninsns;
+
+  vector<char> names;
+  unordered_map<const Block *, uint32_t> index;
+
+  // block is only filled by decodeBinary(), not by a cache hit
+  size_t size() const { return start.size(); }
+
+  uint32_t find(const Block *b) const {
+    auto it = index.find(b);
+    return it == index.end() ? npos : it->second;
+  }
+
+  // Returns the index of b, appending a new row if it was not seen before
+  uint32_t insert(Block *b, bool &inserted) {
+    auto res = index.insert(make_pair(b, (uint32_t)block.size()));
+    inserted = res.second;
+    if (inserted) {
+      block.push_back(b);
+      start.push_back(b->start());
+      end.push_back(b->end());
+      flags.push_back(0);
+      func.push_back(0);
+      name.push_back(0);
+      number.push_back(0);
+      insn.push_back(0);
+      ninsns.push_back(0);
+    }
+    return res.first->second;
+  }
+
+  void setName(uint32_t i, const string &n) {
+    name[i] = names.size();
+    names.insert(names.end(), n.begin(), n.end());
+    names.push_back('\0');
+  }
+
+  string nameOf(uint32_t i) const {
+    if (i == npos) return string();
+    return string(&names[name[i]]);
+  }
+  string nameOf(const Block *b) const { return nameOf(find(b)); }
+  const char *nameText(uint32_t i) const { return &names[name[i]]; }
+
+  void clear() {
+    block.clear();
+    start.clear();
+    end.clear();
+    flags.clear();
+    func.clear();
+    name.clear();
+    number.clear();
+    insn.clear();
+    ninsns.clear();
+    names.clear();
+    index.clear();
+  }
+};
+
+// Block address ranges sorted by start, for mapping an address back to its
+// block. find() is a branchless binary search: the loop always runs log2(n)
+// times and the comparison only selects the next base.
+struct BlockIndex {
+  vector<Address> start;
+  vector<Address> end;
+  vector<uint32_t> block;
+
+  void build(const BlockTable &blocks) {
+    clear();
+    vector<uint32_t> order(blocks.size());
+    for (uint32_t i = 0; i < order.size(); i++) order[i] = i;
+    sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) {
+      return blocks.start[a] != blocks.start[b] ? blocks.start[a] < blocks.start[b] : a < b;
+    });
+    for (auto &bi : order) {
+      start.push_back(blocks.start[bi]);
+      end.push_back(blocks.end[bi]);
+      block.push_back(bi);
+    }
+  }
+
+  // The block starting last at or before a, when it also covers a
+  uint32_t find(Address a) const {
+    size_t n = start.size();
+    if (n == 0 || a < start[0]) return BlockTable::npos;
+    const Address *base = start.data();
+    while (n > 1) {
+      size_t half = n / 2;
+      base = base[half] <= a ? base + half : base;
+      n -= half;
+    }
+    size_t i = base - start.data();
+    return a < end[i] ? block[i] : BlockTable::npos;
+  }
+
+  void clear() {
+    start.clear();
+    end.clear();
+    block.clear();
+  }
+};
+
+// Every edge between two blocks of block_table, once, with its
+// EdgeTypeEnum. Rows are grouped by target block in block id order, in the
+// order that block's sources() lists them; first[bi] is the first row into
+// block bi, and first has one extra entry at the end.
+struct EdgeTable {
+  vector<uint32_t> source;
+  vector<uint32_t> target;
+  vector<uint8_t> type;
+  vector<size_t> first;
+
+  size_t size() const { return source.size(); }
+
+  void build(const BlockTable &blocks) {
+    clear();
+    vector<pair<uint32_t, uint8_t> > seen;
+    for (uint32_t bi = 0; bi < blocks.size(); bi++) {
+      first.push_back(size());
+      seen.clear();
+      for (auto &edge : blocks.block[bi]->sources()) {
+        uint32_t si = blocks.find(edge->src());
+        if (si == BlockTable::npos) continue;
+        auto key = make_pair(si, (uint8_t)edge->type());
+        if (find(seen.begin(), seen.end(), key) != seen.end()) continue;
+        seen.push_back(key);
+        source.push_back(si);
+        target.push_back(bi);
+        type.push_back(key.second);
+      }
+    }
+    first.push_back(size());
+  }
+
+  void clear() {
+    source.clear();
+    target.clear();
+    type.clear();
+    first.clear();
+  }
+};
+
+// Rows first[i] to first[i + 1] of column, for a range based for
+template <typename T>
+struct RowSpan {
+  const T *first;
+  const T *last;
+
+  const T *begin() const { return first; }
+  const T *end() const { return last; }
+  bool empty() const { return first == last; }
+};
+
+template <typename T>
+RowSpan<T> rowsOf(const vector<T> &column, const vector<size_t> &first, size_t i) {
+  return {column.data() + first[i], column.data() + first[i + 1]};
+}
+
+// The tables below are filled from Dyninst once, by extractFunctions(), so
+// the exporters never call into it. Names and other texts are indexes into
+// symbols. A column named x_first has one entry per row plus one at the
+// end: the x of row i are rows x_first[i] to x_first[i + 1] of the x
+// columns.
+
+// Variables as printVar() writes them, one location per loc_ row
+struct VarTable {
+  vector<uint32_t> name;  // cleaned
+  vector<uint32_t> file;
+  vector<int> line;
+  vector<size_t> loc_first;
+  vector<Address> loc_low;
+  vector<Address> loc_high;
+  vector<uint32_t> loc_text;
+
+  size_t size() const { return name.size(); }
+
+  void clear() {
+    name.clear();
+    file.clear();
+    line.clear();
+    loc_first.assign(1, 0);
+    loc_low.clear();
+    loc_high.clear();
+    loc_text.clear();
+  }
+};
+
+// Inlined calls, with their variables in inline_var_table
+struct InlineTable {
+  vector<uint32_t> name;  // demangled and cleaned
+  vector<uint32_t> callsite_file;
+  vector<Offset> callsite_line;
+  vector<size_t> var_first;
+  vector<size_t> range_first;
+  vector<Address> range_low;
+  vector<Address> range_high;
+
+  size_t size() const { return name.size(); }
+
+  void clear() {
+    name.clear();
+    callsite_file.clear();
+    callsite_line.clear();
+    var_first.assign(1, 0);
+    range_first.assign(1, 0);
+    range_low.clear();
+    range_high.clear();
+  }
+};
+
+// Loop trees in preorder. The loops nested in row i are rows i + 1 to
+// subtree_end[i]; the first child is row i + 1 and each child's subtree_end
+// is where its next sibling starts.
+struct LoopTable {
+  vector<uint32_t> name;
+  vector<size_t> subtree_end;
+  vector<size_t> backedge_first;
+  vector<uint32_t> backedge_from;  // block_table rows, npos if not decoded
+  vector<uint32_t> backedge_to;
+  vector<size_t> block_first;
+  vector<uint32_t> blocks;
+
+  size_t size() const { return name.size(); }
+
+  void clear() {
+    name.clear();
+    subtree_end.clear();
+    backedge_first.assign(1, 0);
+    backedge_from.clear();
+    backedge_to.clear();
+    block_first.assign(1, 0);
+    blocks.clear();
+  }
+};
+
+// Call sites. The functions holding the target block of a call are its
+// callee rows: their function_table row (npos for a function that was not
+// decoded) and their cleaned name.
+struct CallTable {
+  vector<Address> address;
+  vector<Address> target;  // 0 when unknown
+  vector<size_t> callee_first;
+  vector<uint32_t> callee;
+  vector<uint32_t> callee_name;
+
+  size_t size() const { return address.size(); }
+
+  void clear() {
+    address.clear();
+    target.clear();
+    callee_first.assign(1, 0);
+    callee.clear();
+    callee_name.clear();
+  }
+};
+
+// Source line statements, sorted by statementBefore()
+struct LineTable {
+  vector<uint32_t> file;  // as the line table has it, not cleaned
+  vector<unsigned int> line;
+  vector<Address> from;
+  vector<Address> to;
+
+  // Largest to of rows 0 to i, set by buildReach(). The rows that reach into
+  // a range starting at a are those after the last one with reach <= a.
+  vector<Address> reach;
+
+  size_t size() const { return from.size(); }
+  bool empty() const { return from.empty(); }
+
+  void buildReach() {
+    reach.resize(size());
+    for (size_t i = 0; i < size(); i++) reach[i] = i == 0 ? to[i] : max(reach[i - 1], to[i]);
+  }
+
+  void push(uint32_t f, unsigned int l, Address start, Address end) {
+    file.push_back(f);
+    line.push_back(l);
+    from.push_back(start);
+    to.push_back(end);
+  }
+
+  void clear() {
+    file.clear();
+    line.clear();
+    from.clear();
+    to.clear();
+    reach.clear();
+  }
+};
+
+// Every decoded function, in funcs order
+struct FunctionTable {
+  static const uint32_t npos = (uint32_t)-1;
+
+  vector<uint32_t> name;  // cleaned
+  vector<Address> entry;
+  vector<size_t> block_first;
+  vector<uint32_t> blocks;  // block_table rows, in Function::blocks() order
+  vector<uint8_t> in_symtab;  // covered by the symbol table, so vars is an array
+  vector<size_t> var_first;
+  vector<size_t> inline_first;
+  vector<size_t> loop_first;  // top level loops and everything nested in them
+  vector<size_t> call_first;
+  // The "Function Entry" hidable, an empty range when there is none
+  vector<Address> prologue_start;
+  vector<Address> prologue_end;
+
+  size_t size() const { return name.size(); }
+
+  RowSpan<uint32_t> blocksOf(uint32_t i) const { return rowsOf(blocks, block_first, i); }
+
+  void clear() {
+    name.clear();
+    entry.clear();
+    block_first.assign(1, 0);
+    blocks.clear();
+    in_symtab.clear();
+    var_first.assign(1, 0);
+    inline_first.assign(1, 0);
+    loop_first.assign(1, 0);
+    call_first.assign(1, 0);
+    prologue_start.clear();
+    prologue_end.clear();
+  }
+};
+
+// Strings numbered in first use order. string_table holds the names an
+// output document refers to by index with --compact-names, and starts over
+// for each document.
+struct StringTable {
+  vector<string> strings;
+  unordered_map<string, uint32_t> index;
+
+  uint32_t intern(const string &str) {
+    auto res = index.insert(make_pair(str, (uint32_t)strings.size()));
+    if (res.second) strings.push_back(str);
+    return res.first->second;
+  }
+
+  void clear() {
+    strings.clear();
+    index.clear();
+  }
+};
+
 // Globals
-map<Block *, string> block_ids;
-map<Block *, set<block_flags> > block_to_flags;
-set<Address> addresses;
+BlockTable block_table;
+InsnTable insn_table;
+StringTable string_table;
+EdgeTable edge_table;
+BlockIndex block_index;
+StringTable symbols;  // names and texts of the tables below
+FunctionTable function_table;
+VarTable var_table;  // the vars of each function
+InlineTable inline_table;
+VarTable inline_var_table;
+LoopTable loop_table;
+CallTable call_table;
+// Loops around each block of a function, outermost first, keyed by
+// loopKey(function row, block row), for the functions looked up so far
+unordered_map<uint64_t, vector<string> > block_loops;
+unordered_set<uint32_t> loops_resolved;  // rows of function_table
+// The functions holding each block, rows block_funcs_first[bi] to
+// block_funcs_first[bi + 1] of block_funcs; built by the first lookup
+vector<size_t> block_funcs_first;
+vector<uint32_t> block_funcs;
+LineTable line_table;  // statements covering an instruction
 SymtabAPI::Symtab *symtab;
 CodeObject::funclist funcs;
+typedef vector<uint32_t> FunctionList;  // rows of function_table
+FunctionList funcs_by_entry;  // sorted by entry address, for paging
 set<string> unique_sourcefiles;
 int curr_block_id;
+double parseSeconds;
+string cacheKey;  // empty when the decode cache is not in use
 
 cxxopts::Options options("simpleopt", "The simpleopt takes a binary file and disassembles it and creates a convinient json file.");
 void printHelp() { cout << options.help() << endl; }
 
+bool setOutputFormat(const string &name) {
+  if (name == "json")
+    outputFormat = fmt_json;
+  else if (name == "cbor")
+    outputFormat = fmt_cbor;
+  else if (name == "msgpack")
+    outputFormat = fmt_msgpack;
+  else
+    return false;
+  return true;
+}
+
+const char *outputExtension() {
+  switch (outputFormat) {
+    case fmt_cbor:
+      return ".cbor";
+    case fmt_msgpack:
+      return ".msgpack";
+    default:
+      return ".json";
+  }
+}
+
+bool setCompression(const string &name) {
+  if (name == "none")
+    outputCompression = comp_none;
+  else if (name == "gzip")
+    outputCompression = comp_gzip;
+  else if (name == "zstd")
+    outputCompression = comp_zstd;
+  else
+    return false;
+  return true;
+}
+
+const char *compressionExtension() {
+  switch (outputCompression) {
+    case comp_gzip:
+      return ".gz";
+    case comp_zstd:
+      return ".zst";
+    default:
+      return "";
+  }
+}
+
+// Reads an address given to option, in decimal or 0x prefixed hex, or exits
+// with a usage error
+Dyninst::Address parseAddressArg(const string &option, const string &text) {
+  size_t used = 0;
+  Dyninst::Address value = 0;
+  if (!text.empty() && text[0] != '-') {
+    try {
+      value = stoul(text, &used, 0);
+    } catch (logic_error &) {  // invalid_argument or out_of_range
+      used = 0;
+    }
+  }
+  if (used == 0 || used != text.size()) {
+    cerr << "Error: --" << option << " expects an address, got " << text << endl;
+    exit(1);
+  }
+  return value;
+}
+
+// --after ADDR or ADDR,N, as PageCursor takes them
+PageCursor parseCursorArg(const string &text) {
+  PageCursor cursor;
+  cursor.resume = true;
+  size_t comma = text.find(',');
+  cursor.after = parseAddressArg("after", text.substr(0, comma));
+  if (comma != string::npos) {
+    cursor.counted = true;
+    cursor.count = parseAddressArg("after", text.substr(comma + 1));
+  }
+  return cursor;
+}
+
 void parseArgs(int argc, char **argv) {
   options.add_options()
     ("b,binary", "Binary File Path", cxxopts::value<std::string>())
     ("f,functions", "Functions", cxxopts::value<vector<string> >()->default_value("null"))
+    ("targeted", "Only parse the functions given with -f instead of the whole binary")
+    ("call-depth", "With --targeted, also parse callees up to this depth", cxxopts::value<int>()->default_value("0"))
+    ("cache-dir", "Directory for cached decoded tables", cxxopts::value<std::string>()->default_value(""))
+    ("format", "Output format: json, cbor or msgpack", cxxopts::value<std::string>()->default_value("json"))
+    ("compress", "Compress the output files: none, gzip or zstd", cxxopts::value<std::string>()->default_value("none"))
+    ("compact-names", "Refer to names by index into a top-level string table")
+    ("integer-block-ids", "Identify blocks by index into a top-level block_names table")
+    ("list-functions", "Print the name, entry and size of every function and exit")
+    ("lookup", "Print the block, functions, loops and source line of these addresses and exit", cxxopts::value<vector<string> >())
+    ("dot-function", "Print the DOT CFG of the function with this name or entry address and exit", cxxopts::value<string>())
+    ("dot-clusters", "Wrap each function of the DOT output in its own cluster subgraph")
+    ("collapse", "Merge straight-line chains of blocks into superblocks in the DOT and assembly output")
+    ("layout", "Also write a layered layout of every CFG to <binary>.layout.json")
+    ("call-graph", "Also write the call graph to <binary>.callgraph.json and .callgraph.dot")
+    ("e,entries", "Only write output for the functions at these entry addresses", cxxopts::value<vector<string> >())
+    ("offset", "Skip this many functions, in entry address order", cxxopts::value<size_t>()->default_value("0"))
+    ("limit", "Write at most this many functions (0 = all)", cxxopts::value<size_t>()->default_value("0"))
+    ("after", "Resume with the functions whose entry address is above ADDR, or with ADDR,N after the first N at or above it", cxxopts::value<string>())
+    ("t,threads", "Number of parse, decode and output threads (0 = all cores); without it the parse uses the OpenMP default and the rest runs on one thread", cxxopts::value<int>())
     ("h,help", "Print usage");
 
   auto result = options.parse(argc, argv);
@@ -49,42 +609,151 @@ void parseArgs(int argc, char **argv) {
   }
   binaryPath = result["binary"].as<std::string>();
   functionNames = result["functions"].as<vector<string> >();
+  numThreads = result.count("threads") ? result["threads"].as<int>() : -1;
+  targetedParse = result.count("targeted") > 0;
+  callDepth = result["call-depth"].as<int>();
+  cacheDir = result["cache-dir"].as<std::string>();
+  compactNames = result.count("compact-names") > 0;
+  integerBlockIds = result.count("integer-block-ids") > 0;
+  listFunctionsOnly = result.count("list-functions") > 0;
+  if (result.count("lookup"))
+    for (auto &addr : result["lookup"].as<vector<string> >())
+      lookupAddrs.push_back(parseAddressArg("lookup", addr));
+  if (result.count("dot-function")) dotFunction = result["dot-function"].as<string>();
+  dotClusters = result.count("dot-clusters") > 0;
+  callGraphOutput = result.count("call-graph") > 0;
+  collapseBlocks = result.count("collapse") > 0;
+  layoutOutput = result.count("layout") > 0;
+  pageOffset = result["offset"].as<size_t>();
+  pageLimit = result["limit"].as<size_t>();
+  if (result.count("after")) pageCursor = parseCursorArg(result["after"].as<string>());
+  if (result.count("entries"))
+    for (auto &entry : result["entries"].as<vector<string> >())
+      entryAddresses.push_back(parseAddressArg("entries", entry));
+  if (!setOutputFormat(result["format"].as<std::string>())) {
+    cerr << "Error: unknown output format " << result["format"].as<std::string>() << endl;
+    exit(1);
+  }
+  if (!setCompression(result["compress"].as<std::string>())) {
+    cerr << "Error: unknown compression " << result["compress"].as<std::string>() << endl;
+    exit(1);
+  }
 }
 
 void setBlockFlags(const Block *block, const Instruction &instr,
-                   set<block_flags> &flags) {
+                   block_flag_set &flags) {
   switch (instr.getCategory()) {
 #if defined(DYNINST_MAJOR_VERSION) && (DYNINST_MAJOR_VERSION >= 10)
     case InstructionAPI::c_VectorInsn:
-      flags.insert(bb_vectorized);
+      flags |= 1 << bb_vectorized;
       break;
 #endif
     case InstructionAPI::c_CallInsn:
-      flags.insert(bb_call);
+      flags |= 1 << bb_call;
       break;
     case InstructionAPI::c_SysEnterInsn:
     case InstructionAPI::c_SyscallInsn:
-      flags.insert(bb_syscall);
+      flags |= 1 << bb_syscall;
       break;
     default:
       break;
   }
-  if (instr.readsMemory()) flags.insert(bb_memory_read);
-  if (instr.writesMemory()) flags.insert(bb_memory_write);
+  if (instr.readsMemory()) flags |= 1 << bb_memory_read;
+  if (instr.writesMemory()) flags |= 1 << bb_memory_write;
 }
 
 string print_clean_string(const std::string &str) {
-  static regex pattern("[^a-zA-Z0-9 /:;,\\.{}\\[\\]<>~|\\-_+()&\\*=$!#]");
-  const size_t len = str.length();
-  std::string str2;
-  if (len > MAX_NAME_LENGTH) {
-    size_t substrlen = (MAX_NAME_LENGTH - 3) / 2;
-    str2 = str.substr(0, substrlen) + "..." + str.substr(len - substrlen);
-  } else {
-    str2 = str;
+  return interned_clean_string(str);
+}
+
+const string &symbol(uint32_t i) { return symbols.strings[i]; }
+
+FunctionList allFunctions() {
+  FunctionList fs(function_table.size());
+  for (uint32_t i = 0; i < fs.size(); i++) fs[i] = i;
+  return fs;
+}
+
+// Sets starts to the addresses of the instructions of block bi, in order
+void insnStarts(uint32_t bi, vector<Address> &starts) {
+  starts.clear();
+  Address a = block_table.start[bi];
+  size_t insn_end = block_table.insn[bi] + block_table.ninsns[bi];
+  for (size_t k = block_table.insn[bi]; k < insn_end; a += insn_table.length[k++])
+    starts.push_back(a);
+}
+
+// Whether a decoded instruction starts at a, walking the block that covers
+// it from its start
+bool insnStartsAt(Address a) {
+  uint32_t bi = block_index.find(a);
+  if (bi == BlockTable::npos) return false;
+  Address cur = block_table.start[bi];
+  size_t insn_end = block_table.insn[bi] + block_table.ninsns[bi];
+  for (size_t k = block_table.insn[bi]; k < insn_end && cur < a; k++)
+    cur += insn_table.length[k];
+  return cur == a;
+}
+
+// Set while printFunction runs on a worker thread. Names are then interned in
+// the function's own table and written as placeholders, which
+// resolveNames() later turns into string_table indices.
+thread_local StringTable *fragment_strings = nullptr;
+
+json namePlaceholder(uint32_t index) {
+  json::binary_t::container_type bytes(4);
+  for (int i = 0; i < 4; i++) bytes[i] = (index >> (8 * i)) & 0xff;
+  return json::binary(bytes);
+}
+
+uint32_t placeholderIndex(const json &js) {
+  const json::binary_t &bytes = js.get_binary();
+  uint32_t index = 0;
+  for (int i = 0; i < 4; i++) index |= (uint32_t)bytes[i] << (8 * i);
+  return index;
+}
+
+// A name as written to the output: the string itself, or its index in
+// string_table with --compact-names
+json nameRef(const string &name) {
+  if (!compactNames) return name;
+  if (fragment_strings) return namePlaceholder(fragment_strings->intern(name));
+  return string_table.intern(name);
+}
+
+// A block as written to the output: its name, or its index in block_table
+// with --integer-block-ids. Every block name is distinct, so --compact-names
+// only interns the function part and writes [function name, n] for
+// "<function>: B<n>".
+json blockRef(uint32_t bi) {
+  if (integerBlockIds) return bi == BlockTable::npos ? json() : json(bi);
+  if (!compactNames) return block_table.nameOf(bi);
+  if (bi == BlockTable::npos) return json();
+  return json::array({nameRef(symbol(function_table.name[block_table.func[bi]])),
+                      block_table.number[bi]});
+}
+
+// An edge between two blocks: {"from": .., "to": ..} keyed by fromKey and
+// toKey, or a plain [from, to] pair with --integer-block-ids
+json edgeRef(uint32_t from, uint32_t to, const char *fromKey, const char *toKey) {
+  if (integerBlockIds) return json::array({blockRef(from), blockRef(to)});
+  return {{fromKey, blockRef(from)}, {toKey, blockRef(to)}};
+}
+
+// Side table of block names, indexed by block id. A document covering only
+// some of the functions carries just their blocks, as an object keyed by id.
+json blockNames(const FunctionList &fs) {
+  if (fs.size() == function_table.size()) {
+    json names = json::array();
+    for (uint32_t i = 0; i < block_table.size(); i++)
+      names.push_back(block_table.nameOf(i));
+    return names;
   }
 
-  return regex_replace(str, pattern, "?");
+  json names = json::object();
+  for (auto &fi : fs)
+    for (auto &bi : function_table.blocksOf(fi)) names[itos(bi)] = block_table.nameOf(bi);
+  return names;
 }
 
 string number_to_hex(const unsigned long val) {
@@ -115,19 +784,14 @@ inline string getRegFromFullName(const string &fullname) {
   return fullname.substr(fullname.rfind("::") + 2);
 }
 
-json printVar(localVar *var) {
+void extractVar(localVar *var, VarTable &vars) {
   string name = var->getName();
   int lineNum = var->getLineNum();
   string fileName = var->getFileName();
 
-  json locations_json = json::array();
   vector<VariableLocation> locations = var->getLocationLists();
   for (auto &location : locations) {
     long frameOffset = location.frameOffset;
-    Address lowPC = location.lowPC;
-    Address hiPC = location.hiPC;
-    string hiPC_str = number_to_hex(hiPC);
-    string lowPC_str = number_to_hex(lowPC);
 
     MachRegister mr_reg = location.mr_reg;
     string full_regName = mr_reg.name();
@@ -161,19 +825,17 @@ json printVar(localVar *var) {
                          ")";  // at&t syntax
       }
     }
-    locations_json.push_back({{"start", lowPC_str},
-                              {"end", hiPC_str},
-                              {"location", finalVarString}});
+    vars.loc_low.push_back(location.lowPC);
+    vars.loc_high.push_back(location.hiPC);
+    vars.loc_text.push_back(symbols.intern(finalVarString));
   }
-  return {{"name", print_clean_string(name)},
-          {"file", fileName},
-          {"line", lineNum},
-          {"locations", locations_json}};
+  vars.loc_first.push_back(vars.loc_low.size());
+  vars.name.push_back(symbols.intern(print_clean_string(name)));
+  vars.file.push_back(symbols.intern(clean_path(fileName)));
+  vars.line.push_back(lineNum);
 }
 
-json printFnVars(FunctionBase *f) {
-  json result = json::array();
-
+void extractFnVars(FunctionBase *f, VarTable &vars) {
   vector<localVar *> thisLocalVars;
   vector<localVar *> thisParams;
 
@@ -187,101 +849,56 @@ json printFnVars(FunctionBase *f) {
   for(auto &thisParam : thisParams)
     allVars.insert(thisParam);
 
-  for (auto &allVar : allVars) {
-    // printVar
-    result.push_back(printVar(allVar));
-  }
-
-  return result;
+  for (auto &allVar : allVars)
+    extractVar(allVar, vars);
 }
 
-json printInlineEntries(set<InlinedFunction *> &ifuncs,
-                        json result = json::array()) {
+// Only the calls inlined directly into a function are listed; the output
+// never carried the ones nested further inside them
+void extractInlines(set<InlinedFunction *> &ifuncs) {
   for (auto &ifunc : ifuncs) {
     int status;
     const char *name =
         abi::__cxa_demangle(ifunc->getName().c_str(), 0, 0, &status);
     const char *name_str = name ? name : ifunc->getName().c_str();
-    const FuncRangeCollection &ranges = ifunc->getRanges();
-
-    json ranges_json = json::array();
-    for (auto range : ranges)
-      ranges_json.push_back({{"start", range.low()}, {"end", range.high()}});
-
-    result.push_back({
-        {"name", print_clean_string(name_str)},
-        {"vars", printFnVars(static_cast<FunctionBase *>(ifunc))},
-        {"ranges", ranges_json},
-        {"callsite_file", ifunc->getCallsite().first},
-        {"callsite_line", ifunc->getCallsite().second},
-    });
-
+    inline_table.name.push_back(symbols.intern(print_clean_string(name_str)));
     free(const_cast<char *>(name));
 
-    SymtabAPI::InlineCollection ic = ifunc->getInlines();
-    set<InlinedFunction *> next_funcs;
-    for (auto &j : ic)
-      next_funcs.insert(static_cast<InlinedFunction *>(j));
-    if (!next_funcs.empty())
-      printInlineEntries(next_funcs, result);
-  }
-  return result;
-}
-
-json printInlines(ParseAPI::Function *f) {
-  set<FunctionBase *> top_level_functions;
-  for (const auto &i : f->blocks()) {
-    SymtabAPI::Function *symt_func = nullptr;
-    symtab->getContainingFunction(i->start(), symt_func);
-    if (!symt_func) continue;
-    top_level_functions.insert(symt_func);
-  }
-  if (top_level_functions.empty()) return {};
+    inline_table.callsite_file.push_back(symbols.intern(clean_path(ifunc->getCallsite().first)));
+    inline_table.callsite_line.push_back(ifunc->getCallsite().second);
 
-  set<InlinedFunction *> ifuncs;
-  json vars_json = json::array();
-  for(auto &i : top_level_functions) {
-    json top_level_vars_json = printFnVars(static_cast<FunctionBase *>(i));
-    for(auto &vars_i : top_level_vars_json)
-      vars_json.push_back(vars_i);
+    extractFnVars(static_cast<FunctionBase *>(ifunc), inline_var_table);
+    inline_table.var_first.push_back(inline_var_table.size());
 
-    SymtabAPI::InlineCollection ic = i->getInlines();
-    for (auto &j : ic) {
-      InlinedFunction *ifunc = static_cast<InlinedFunction *>(j);
-      if (addresses.find(ifunc->getOffset()) == addresses.end()) continue;
-      ifuncs.insert(ifunc);
+    for (auto range : ifunc->getRanges()) {
+      inline_table.range_low.push_back(range.low());
+      inline_table.range_high.push_back(range.high());
     }
+    inline_table.range_first.push_back(inline_table.range_low.size());
   }
-  if (ifuncs.empty()) return {{"vars", vars_json}, {"inlines", {}}};
-
-  return {{"vars", vars_json}, {"inlines", printInlineEntries(ifuncs)}};
 }
 
-json printLoopEntry(LoopTreeNode *lt) {
-  json loop_json = json::object();
-
-  if (lt->loop) {
-    vector<Edge *> backedges;
-    vector<Block *> blocks;
-    lt->loop->getBackEdges(backedges);
-    lt->loop->getLoopBasicBlocks(blocks);
-
-    loop_json["name"] = lt->name();
-
-    if (!backedges.empty()) {
-      for (auto &e : backedges) {
-        loop_json["backedges"].push_back({
-            {"from", block_ids[e->src()]},
-            {"to", block_ids[e->trg()]},
-        });
-      }
-    }
-    for (auto &block : blocks)
-      loop_json["blocks"].push_back(block_ids[block]);
+// Appends lt and the loops nested in it to loop_table
+void extractLoop(LoopTreeNode *lt) {
+  size_t row = loop_table.size();
+  vector<Edge *> backedges;
+  vector<Block *> blocks;
+  lt->loop->getBackEdges(backedges);
+  lt->loop->getLoopBasicBlocks(blocks);
+
+  loop_table.name.push_back(symbols.intern(lt->name()));
+  loop_table.subtree_end.push_back(0);
+  for (auto &e : backedges) {
+    loop_table.backedge_from.push_back(block_table.find(e->src()));
+    loop_table.backedge_to.push_back(block_table.find(e->trg()));
   }
-  for (auto &i : lt->children)
-    loop_json["loops"].push_back(printLoopEntry(i));
-  return loop_json;
+  loop_table.backedge_first.push_back(loop_table.backedge_from.size());
+  for (auto &block : blocks)
+    loop_table.blocks.push_back(block_table.find(block));
+  loop_table.block_first.push_back(loop_table.blocks.size());
+
+  for (auto &i : lt->children) extractLoop(i);
+  loop_table.subtree_end[row] = loop_table.size();
 }
 
 bool matchOperands(
@@ -318,10 +935,13 @@ bool matchOperands(
   return true;
 }
 
-json getFuncBegin(ParseAPI::Function* f) {
+// Finds the push %rbp; mov %rsp, %rbp that sets up the frame of f
+bool getFuncBegin(ParseAPI::Function* f, Address &start, Address &end) {
   auto blocks = f->blocks();
+  if (blocks.empty()) return false;
   ParseAPI::Block::Insns insns;
   (*blocks.begin())->getInsns(insns);
+  if (insns.empty()) return false;
 
   auto itm = insns.begin();
   auto instruction = itm->second;
@@ -331,12 +951,12 @@ json getFuncBegin(ParseAPI::Function* f) {
     vector<Operand> operands;
     instruction.getOperands(operands);
     
-    if(!matchOperands({Dyninst::x86_64::rsp, Dyninst::x86_64::rbp}, {}, operands)) return {};
+    if(!matchOperands({Dyninst::x86_64::rsp, Dyninst::x86_64::rbp}, {}, operands)) return false;
   }
-  else return {};
+  else return false;
 
   itm++;
-  if(itm == insns.end()) return {};
+  if(itm == insns.end()) return false;
   instruction = itm->second;
 
   operation = instruction.getOperation();
@@ -348,334 +968,2139 @@ json getFuncBegin(ParseAPI::Function* f) {
       {Dyninst::x86_64::rsp}, // Read Reg
       {Dyninst::x86_64::rbp, Dyninst::x86_64::rsp}, // Write Reg
       operands
-    )) return {};
+    )) return false;
   }
-  else return {};
-
-  return {
-    {"start", insns.begin()->first},
-    {"end", itm->first},
-    {"name", "Function Entry"}
-  };
-}
-
-json printSourceFiles() {
-   if (unique_sourcefiles.empty()) return json::array();
+  else return false;
 
-   json sourceFilesJson = json::array();
-   for (const auto &file : unique_sourcefiles) {
-     json jsonFile;
-     jsonFile["file"] = file;
-     sourceFilesJson.push_back(jsonFile);
-   }
-   return sourceFilesJson;
+  start = insns.begin()->first;
+  end = itm->first;
+  return true;
 }
 
-json printParse() {
-  json js;
-
-  // setBlockIds()
-  // unsigned long id = 0;
-  // for (auto &fun : funcs) {
-  //   ParseAPI::Function::blocklist blocks = fun->blocks();
-  //   for (const auto &i : blocks)
-  //     block_ids[i] = id++;
-  // }
-
-  // generateLineInfo()
-  set<Statement::Ptr> all_lines;
-  vector<Statement::Ptr> cur_lines;
-
-  for (auto &addri : addresses) {
-    cur_lines.clear();
-    symtab->getSourceLines(cur_lines, addri);
-    if (cur_lines.empty()) continue;
-    copy(cur_lines.begin(), cur_lines.end(),
-         inserter(all_lines, all_lines.begin()));
-  }
-  for (auto &li : all_lines) {
-    js["lines"].push_back({
-        {"file", print_clean_string(li->getFile())},
-        {"line", li->getLine()},
-        {"from", li->startAddr()},
-        {"to", li->endAddr()},
-    });
+// Appends f to function_table, reading everything printFunction() needs
+void extractFunction(ParseAPI::Function *f,
+                     const unordered_map<const ParseAPI::Function *, uint32_t> &rows) {
+  function_table.name.push_back(symbols.intern(print_clean_string(f->name())));
+  function_table.entry.push_back(f->addr());
+  for (const auto &block : f->blocks())
+    function_table.blocks.push_back(block_table.find(block));
+  function_table.block_first.push_back(function_table.blocks.size());
+
+  // Variables and inlined calls come from the symbol table functions
+  // covering the blocks
+  set<FunctionBase *> top_level_functions;
+  for (const auto &i : f->blocks()) {
+    SymtabAPI::Function *symt_func = nullptr;
+    symtab->getContainingFunction(i->start(), symt_func);
+    if (!symt_func) continue;
+    top_level_functions.insert(symt_func);
   }
+  function_table.in_symtab.push_back(!top_level_functions.empty());
 
-  // generateFunctionTable
-  for (auto &f : funcs) {
-    json basic_blocks = json::array();
-    // printFunctionEntry
-    auto blocks = f->blocks();
-
-    json hidables = json::array();
-    // hidables
-    auto funcBeginHidable = getFuncBegin(f);
-    if(!funcBeginHidable.empty())
-      hidables.push_back(funcBeginHidable);
-
-
-    for (const auto &block : blocks) {
-      json basic_block = json::object();
-      // printBlockEntry
-      basic_block["id"] = block_ids[block];
-      basic_block["start"] = block->start();
-      basic_block["end"] = block->end();
-
-
-      const set<block_flags> &flags = block_to_flags[block];
-      vector<string> jsonFlags;
-      for (auto &i : flags) {
-        switch (i) {
-          case bb_vectorized:
-            basic_block["flags"].push_back("vector");
-            break;
-          case bb_memory_read:
-            basic_block["flags"].push_back("memread");
-            break;
-          case bb_memory_write:
-            basic_block["flags"].push_back("memwrite");
-            break;
-          case bb_call:
-            basic_block["flags"].push_back("call");
-            break;
-          case bb_syscall:
-            basic_block["flags"].push_back("syscall");
-            break;
-          case bb_fp:
-            basic_block["flags"].push_back("fp");
-            break;
-        }
-      }
+  set<InlinedFunction *> ifuncs;
+  for(auto &i : top_level_functions) {
+    extractFnVars(static_cast<FunctionBase *>(i), var_table);
 
-      basic_blocks.push_back(basic_block);
+    SymtabAPI::InlineCollection ic = i->getInlines();
+    for (auto &j : ic) {
+      InlinedFunction *ifunc = static_cast<InlinedFunction *>(j);
+      if (!insnStartsAt(ifunc->getOffset())) continue;
+      ifuncs.insert(ifunc);
     }
-
-    // printInlines
-    json inlines_json = printInlines(f);
-
-    json loops_json;
-    LoopTreeNode *lt = f->getLoopTree();
-    if (lt) {
-      loops_json = printLoopEntry(lt);
+  }
+  function_table.var_first.push_back(var_table.size());
+  extractInlines(ifuncs);
+  function_table.inline_first.push_back(inline_table.size());
+
+  LoopTreeNode *lt = f->getLoopTree();
+  if (lt)
+    for (auto &i : lt->children) extractLoop(i);
+  function_table.loop_first.push_back(loop_table.size());
+
+  vector<ParseAPI::Function *> targets;
+  for (auto &edge : f->callEdges()) {
+    if (!edge) continue;
+    Block *from = edge->src();
+    Block *to = edge->trg();
+
+    call_table.address.push_back(from->lastInsnAddr());
+    if (to && to->start() != (unsigned long)-1)
+      call_table.target.push_back(to->start());
+    else
+      call_table.target.push_back(0);
+
+    targets.clear();
+    if (to) to->getFuncs(targets);
+    for (auto &t : targets) {
+      auto row = rows.find(t);
+      call_table.callee.push_back(row == rows.end() ? FunctionTable::npos : row->second);
+      call_table.callee_name.push_back(symbols.intern(print_clean_string(t->name())));
     }
+    call_table.callee_first.push_back(call_table.callee.size());
+  }
+  function_table.call_first.push_back(call_table.size());
 
-    // printCalls
-    json calls_json = json::array();
-    for (auto &edge : f->callEdges()) {
-      if (!edge) continue;
-      Block *from = edge->src();
-      Block *to = edge->trg();
+  Address start = 0, end = 0;
+  getFuncBegin(f, start, end);
+  function_table.prologue_start.push_back(start);
+  function_table.prologue_end.push_back(end);
+}
 
-      json call_json = json::object();
-      call_json["address"] = from->lastInsnAddr();
+// Fills function_table and the tables hanging off it. This runs serially:
+// loop trees, containing functions and variable lists are computed lazily
+// inside Dyninst, which is not safe from the printFunctions() threads.
+void extractFunctions() {
+  unordered_map<const ParseAPI::Function *, uint32_t> rows;
+  for (auto &f : funcs) rows.insert(make_pair(f, (uint32_t)rows.size()));
+  for (auto &f : funcs) extractFunction(f, rows);
+}
 
-      if (to && to->start() != (unsigned long)-1)
-        call_json["target"] = to->start();
-      else
-        call_json["target"] = 0;
+uint64_t fnv1a(const char *data, size_t len,
+               uint64_t hash = 14695981039346656037ULL) {
+  for (size_t i = 0; i < len; i++) {
+    hash ^= (unsigned char)data[i];
+    hash *= 1099511628211ULL;
+  }
+  return hash;
+}
 
-      vector<ParseAPI::Function *> funcs;
-      to->getFuncs(funcs);
-      if (!funcs.empty()) {
-        json target_func_json = json::array();
-        for (auto j = funcs.begin(); j != funcs.end(); j++)
-          target_func_json.push_back(print_clean_string((*j)->name()));
-        call_json["target_func"] = target_func_json;
+template <typename Ehdr, typename Shdr>
+string readBuildId(ifstream &in) {
+  Ehdr ehdr;
+  in.seekg(0);
+  if (!in.read((char *)&ehdr, sizeof(ehdr))) return "";
+
+  for (unsigned int i = 0; i < ehdr.e_shnum; i++) {
+    Shdr shdr;
+    in.seekg(ehdr.e_shoff + (uint64_t)i * ehdr.e_shentsize);
+    if (!in.read((char *)&shdr, sizeof(shdr))) return "";
+    if (shdr.sh_type != SHT_NOTE) continue;
+
+    vector<char> notes(shdr.sh_size);
+    in.seekg(shdr.sh_offset);
+    if (!in.read(notes.data(), notes.size())) return "";
+
+    // Elf32_Nhdr and Elf64_Nhdr share the same layout
+    size_t pos = 0;
+    while (pos + sizeof(Elf64_Nhdr) <= notes.size()) {
+      Elf64_Nhdr *nhdr = (Elf64_Nhdr *)&notes[pos];
+      size_t name_pos = pos + sizeof(Elf64_Nhdr);
+      size_t desc_pos = name_pos + ((nhdr->n_namesz + 3) & ~3u);
+      size_t next_pos = desc_pos + ((nhdr->n_descsz + 3) & ~3u);
+      if (next_pos > notes.size()) break;
+      if (nhdr->n_type == NT_GNU_BUILD_ID && nhdr->n_namesz == 4 &&
+          memcmp(&notes[name_pos], "GNU", 4) == 0) {
+        stringstream hex_id;
+        for (size_t j = 0; j < nhdr->n_descsz; j++)
+          hex_id << hex << setw(2) << setfill('0')
+                 << (unsigned int)(unsigned char)notes[desc_pos + j];
+        return hex_id.str();
       }
-      calls_json.push_back(call_json);
+      pos = next_pos;
     }
+  }
+  return "";
+}
 
-    js["functions"].push_back(json::object({
-        {"name", print_clean_string(f->name())},
-        {"entry", f->addr()},
-        {"basicblocks", basic_blocks},
-        {"vars", inlines_json["vars"]},
-        {"calls", calls_json},
-        {"inlines", inlines_json["inlines"]},
-        {"loops", loops_json["loops"]},
-        {"hidables", hidables}
-    }));
+// Identifies the contents of a binary: its GNU build-id when it has one,
+// otherwise a hash of the whole file together with its size and mtime.
+string binaryFingerprint(const string &path) {
+  struct stat st;
+  if (stat(path.c_str(), &st) != 0) return "";
+  ifstream in(path, ios::binary);
+  if (!in) return "";
+
+  unsigned char ident[EI_NIDENT];
+  if (in.read((char *)ident, EI_NIDENT) && memcmp(ident, ELFMAG, SELFMAG) == 0) {
+    string build_id = ident[EI_CLASS] == ELFCLASS64
+                          ? readBuildId<Elf64_Ehdr, Elf64_Shdr>(in)
+                          : readBuildId<Elf32_Ehdr, Elf32_Shdr>(in);
+    if (!build_id.empty()) return "bid-" + build_id;
   }
 
-  return js;
+  in.clear();
+  in.seekg(0);
+  uint64_t hash = 14695981039346656037ULL;
+  vector<char> buf(1 << 20);
+  while (in.read(buf.data(), buf.size()) || in.gcount() > 0)
+    hash = fnv1a(buf.data(), in.gcount(), hash);
+
+  stringstream key;
+  key << "fnv-" << hex << hash << "-" << dec << st.st_size << "-" << st.st_mtime;
+  return key.str();
 }
 
-string writeDOT() {
-  stringstream out;
+// The cached results also depend on which functions were selected
+string computeCacheKey(const string &path) {
+  string fingerprint = binaryFingerprint(path);
+  if (fingerprint.empty()) return "";
+
+  stringstream opts;
+  opts << CACHE_FORMAT_VERSION << "\n" << targetedParse << "\n" << callDepth;
+  for (auto &name : functionNames) opts << "\n" << name;
+  // and on the word size and byte order the tables were written with
+  const uint16_t probe = 1;
+  opts << "\n" << sizeof(size_t) << (*(const uint8_t *)&probe ? "le" : "be");
+  string opts_str = opts.str();
+
+  stringstream key;
+  key << fingerprint << "-" << hex << fnv1a(opts_str.data(), opts_str.size());
+  return key.str();
+}
 
-  out << "digraph g {" << endl;
+// A cache entry holds every decoded table, each column as the raw bytes of
+// its vector, so a hit restores what decodeBinary() leaves behind and all
+// outputs are built from it as usual. The bytes are native, which the key
+// accounts for.
+string cachePath() {
+  return cacheDir + "/" + cacheKey + ".tables";
+}
 
-  for (auto &f : funcs) {
-    if (f->blocks().empty()) continue;
+// Calls visit(key, column) for every column of the tables decodeBinary()
+// fills. The indexes built from them are not stored.
+template <typename F>
+void visitVarColumns(F &visit, const string &prefix, VarTable &vars) {
+  visit(prefix + ".name", vars.name);
+  visit(prefix + ".file", vars.file);
+  visit(prefix + ".line", vars.line);
+  visit(prefix + ".loc_first", vars.loc_first);
+  visit(prefix + ".loc_low", vars.loc_low);
+  visit(prefix + ".loc_high", vars.loc_high);
+  visit(prefix + ".loc_text", vars.loc_text);
+}
 
-    for (const auto &block : f->blocks()) {
-      ParseAPI::Block::Insns insns;
-      block->getInsns(insns);
-      stringstream instr_stream;
+template <typename F>
+void visitColumns(F &visit) {
+  visit("block.start", block_table.start);
+  visit("block.end", block_table.end);
+  visit("block.flags", block_table.flags);
+  visit("block.func", block_table.func);
+  visit("block.name", block_table.name);
+  visit("block.number", block_table.number);
+  visit("block.insn", block_table.insn);
+  visit("block.ninsns", block_table.ninsns);
+  visit("block.names", block_table.names);
+  visit("insn.length", insn_table.length);
+  visit("insn.category", insn_table.category);
+  visit("insn.text", insn_table.text);
+  visit("insn.texts", insn_table.texts);
+  visit("edge.source", edge_table.source);
+  visit("edge.target", edge_table.target);
+  visit("edge.type", edge_table.type);
+  visit("edge.first", edge_table.first);
+  visit("function.name", function_table.name);
+  visit("function.entry", function_table.entry);
+  visit("function.block_first", function_table.block_first);
+  visit("function.blocks", function_table.blocks);
+  visit("function.in_symtab", function_table.in_symtab);
+  visit("function.var_first", function_table.var_first);
+  visit("function.inline_first", function_table.inline_first);
+  visit("function.loop_first", function_table.loop_first);
+  visit("function.call_first", function_table.call_first);
+  visit("function.prologue_start", function_table.prologue_start);
+  visit("function.prologue_end", function_table.prologue_end);
+  visitVarColumns(visit, "var", var_table);
+  visit("inline.name", inline_table.name);
+  visit("inline.callsite_file", inline_table.callsite_file);
+  visit("inline.callsite_line", inline_table.callsite_line);
+  visit("inline.var_first", inline_table.var_first);
+  visit("inline.range_first", inline_table.range_first);
+  visit("inline.range_low", inline_table.range_low);
+  visit("inline.range_high", inline_table.range_high);
+  visitVarColumns(visit, "inline_var", inline_var_table);
+  visit("loop.name", loop_table.name);
+  visit("loop.subtree_end", loop_table.subtree_end);
+  visit("loop.backedge_first", loop_table.backedge_first);
+  visit("loop.backedge_from", loop_table.backedge_from);
+  visit("loop.backedge_to", loop_table.backedge_to);
+  visit("loop.block_first", loop_table.block_first);
+  visit("loop.blocks", loop_table.blocks);
+  visit("call.address", call_table.address);
+  visit("call.target", call_table.target);
+  visit("call.callee_first", call_table.callee_first);
+  visit("call.callee", call_table.callee);
+  visit("call.callee_name", call_table.callee_name);
+  visit("line.file", line_table.file);
+  visit("line.line", line_table.line);
+  visit("line.from", line_table.from);
+  visit("line.to", line_table.to);
+}
 
-      for (auto &instr : insns)
-        instr_stream << hex << "0x" << instr.first << ": " << instr.second.format() << "\\n";
-      string instr_str = instr_stream.str();
-      instr_str = instr_str.substr(0, instr_str.size()-2);
+struct PackColumn {
+  json &tables;
 
-      // Set the basic block label to: function_name\n[instruction list]
-      out << "B" << block_ids[block] << " [shape=box, style=solid, label=\"";
-      out << print_clean_string(f->name());
-      out << "\\n" << instr_str << "\"];" << endl;
-    }
+  template <typename T>
+  void operator()(const string &key, const vector<T> &column) {
+    const uint8_t *bytes = reinterpret_cast<const uint8_t *>(column.data());
+    tables[key] = json::binary(vector<uint8_t>(bytes, bytes + column.size() * sizeof(T)));
   }
-
-  for (auto &f : funcs) {
-    for (const auto &block: f->blocks()) {
-      for (auto &edge : block->sources()) {
-        auto sourcei = block_ids.find(edge->src());
-        auto targeti = block_ids.find(edge->trg());
-        if (sourcei == block_ids.end() || targeti == block_ids.end()) continue;
-        out << "B" << sourcei->second << " -> B" << targeti->second
-            << " [style=solid, color=\"black\"];" << endl;
-      }
+};
+
+struct UnpackColumn {
+  const json &tables;
+  bool ok;
+
+  template <typename T>
+  void operator()(const string &key, vector<T> &column) {
+    column.clear();
+    auto it = tables.find(key);
+    if (it == tables.end() || !it->is_binary() || it->get_binary().size() % sizeof(T) != 0) {
+      ok = false;
+      return;
     }
+    const vector<uint8_t> &bytes = it->get_binary();
+    column.resize(bytes.size() / sizeof(T));
+    if (!bytes.empty()) memcpy(column.data(), bytes.data(), bytes.size());
   }
-  out << "}" << endl << endl;
-  return out.str();
+};
+
+// Every x_first column has a row per row of its table plus one, and ends
+// at the size of the rows it indexes
+template <typename T>
+bool firstMatches(const vector<size_t> &first, size_t rows, const vector<T> &column) {
+  return first.size() == rows + 1 && first.back() == column.size();
 }
 
-string block_to_name(const ParseAPI::Function *fn, const ParseAPI::Block *block, const int cur_id) {
-  return print_clean_string(fn->name() + ": B" + itos(cur_id));
+bool tablesConsistent() {
+  size_t nblocks = block_table.size(), nfuncs = function_table.size();
+  return block_table.end.size() == nblocks && block_table.flags.size() == nblocks &&
+         block_table.func.size() == nblocks && block_table.name.size() == nblocks &&
+         block_table.number.size() == nblocks && block_table.insn.size() == nblocks &&
+         block_table.ninsns.size() == nblocks &&
+         insn_table.length.size() == insn_table.size() &&
+         insn_table.category.size() == insn_table.size() &&
+         insn_table.text.size() == insn_table.size() &&
+         firstMatches(edge_table.first, nblocks, edge_table.source) &&
+         firstMatches(function_table.block_first, nfuncs, function_table.blocks) &&
+         firstMatches(function_table.var_first, nfuncs, var_table.name) &&
+         firstMatches(function_table.inline_first, nfuncs, inline_table.name) &&
+         firstMatches(function_table.loop_first, nfuncs, loop_table.name) &&
+         firstMatches(function_table.call_first, nfuncs, call_table.address) &&
+         firstMatches(var_table.loc_first, var_table.size(), var_table.loc_low) &&
+         firstMatches(inline_var_table.loc_first, inline_var_table.size(), inline_var_table.loc_low) &&
+         firstMatches(inline_table.var_first, inline_table.size(), inline_var_table.name) &&
+         firstMatches(inline_table.range_first, inline_table.size(), inline_table.range_low) &&
+         firstMatches(loop_table.backedge_first, loop_table.size(), loop_table.backedge_from) &&
+         firstMatches(loop_table.block_first, loop_table.size(), loop_table.blocks) &&
+         firstMatches(call_table.callee_first, call_table.size(), call_table.callee) &&
+         line_table.file.size() == line_table.size() && line_table.line.size() == line_table.size() &&
+         line_table.to.size() == line_table.size();
 }
 
-// All functions must be called after this one.
-int decode(const string binaryPath) {
-  // Clear previous states
-  for(auto &iter: block_ids) delete iter.first;
-  block_ids.clear();
-  block_to_flags.clear();
-  addresses.clear();
-  if(symtab) {
-    delete symtab;
-    symtab = nullptr;
+// Reads the tables of the cache entry into the (cleared) globals
+bool loadCachedTables() {
+  ifstream in(cachePath(), ios::binary);
+  if (!in) return false;
+  json tables;
+  try {
+    tables = json::from_cbor(in);
+  } catch (json::exception &) {
+    return false;
   }
-  funcs.clear();
-  unique_sourcefiles.clear();
-  curr_block_id = 0;
 
-
-  bool isParsable = SymtabAPI::Symtab::openFile(symtab, binaryPath);
-  if (!isParsable) {
-    cerr << "Error: file " << binaryPath << " can not be parsed" << endl;
-    return -1;
+  UnpackColumn unpack{tables, true};
+  visitColumns(unpack);
+  auto strings = tables.find("symbols");
+  if (!unpack.ok || strings == tables.end() || !strings->is_array()) return false;
+  for (auto &str : *strings) {
+    if (!str.is_string()) return false;
+    symbols.intern(str.get<string>());
   }
-  SymtabCodeSource *sts =
-      new SymtabCodeSource(const_cast<char *>(binaryPath.c_str()));
-  CodeObject *co = new CodeObject(sts);
-  co->parse();
+  return tablesConsistent();
+}
 
-  if (functionNames.size() == 0 || (functionNames.size() == 1 && functionNames[0] == "null")) {
-    funcs = co->funcs();
-  } else {
-    for (auto &func : co->funcs())
-      if (find(functionNames.begin(), functionNames.end(), func->name()) != functionNames.end())
-        funcs.insert(func);
-  }
-  if (funcs.empty()) {
-    cerr << "Error: no functions in file" << endl;
-    return -1;
+// Written to a temporary file first so a concurrent reader never sees a
+// partial entry.
+void storeCachedTables() {
+  json tables;
+  PackColumn pack{tables};
+  visitColumns(pack);
+  tables["symbols"] = symbols.strings;
+
+  mkdir(cacheDir.c_str(), 0755);
+  string path = cachePath();
+  string tmp_path = path + ".tmp" + itos(getpid());
+  ofstream out(tmp_path, ios::binary);
+  json::to_cbor(tables, out);
+  out.close();
+  if (!out || rename(tmp_path.c_str(), path.c_str()) != 0) {
+    cerr << "Warning: could not write cache entry " << path << endl;
+    remove(tmp_path.c_str());
   }
+}
 
-  // create an Instruction decoder which will convert the binary opcodes to
-  // strings
-  ParseAPI::Function *anyfunc = *funcs.begin();
-  InstructionDecoder decoder(
-      anyfunc->isrc()->getPtrToInstruction(anyfunc->addr()),
-      InstructionDecoder::maxInstructionLength, anyfunc->region()->getArch());
+json printSourceFiles() {
+   if (unique_sourcefiles.empty()) return json::array();
 
-  for (auto &f : funcs) {
-    if (f->blocks().empty()) continue;
+   json sourceFilesJson = json::array();
+   for (const auto &file : unique_sourcefiles) {
+     json jsonFile;
+     jsonFile["file"] = file;
+     sourceFilesJson.push_back(jsonFile);
+   }
+   return sourceFilesJson;
+}
 
-    for (const auto &block : f->blocks()) {
-      Address icur = block->start();
-      Address iend = block->last();
-      set<block_flags> flags;
-      while (icur <= iend) {
-        addresses.insert(icur);
-        const unsigned char *raw_insnptr =
-            (const unsigned char *)f->isrc()->getPtrToInstruction(icur);
-#if defined(DYNINST_MAJOR_VERSION) && (DYNINST_MAJOR_VERSION >= 10)
-        Instruction instr = decoder.decode(raw_insnptr);
-#else
-        Instruction::Ptr ip = decoder.decode(raw_insnptr);
-        Instruction instr = *ip;
-#endif
-        icur += instr.size();
-        setBlockFlags(block, instr, flags);
-      }
-      block_ids[block] = block_to_name(f, block, curr_block_id++);
-      block_to_flags.insert(make_pair(block, flags));
-    }
+json printLine(size_t i) {
+  return {
+      {"file", nameRef(symbol(line_table.file[i]))},
+      {"line", line_table.line[i]},
+      {"from", line_table.from[i]},
+      {"to", line_table.to[i]},
+  };
+}
+
+json printVar(const VarTable &vars, size_t i) {
+  json locations_json = json::array();
+  for (size_t l = vars.loc_first[i]; l < vars.loc_first[i + 1]; l++) {
+    // Binary formats carry addresses as native integers
+    if (outputFormat == fmt_json)
+      locations_json.push_back({{"start", number_to_hex(vars.loc_low[l])},
+                                {"end", number_to_hex(vars.loc_high[l])},
+                                {"location", symbol(vars.loc_text[l])}});
+    else
+      locations_json.push_back({{"start", vars.loc_low[l]},
+                                {"end", vars.loc_high[l]},
+                                {"location", symbol(vars.loc_text[l])}});
   }
+  return {{"name", nameRef(symbol(vars.name[i]))},
+          {"file", nameRef(symbol(vars.file[i]))},
+          {"line", vars.line[i]},
+          {"locations", locations_json}};
+}
 
-  vector<Statement::Ptr> cur_lines;
+json printInline(size_t i) {
+  json vars_json = json::array();
+  for (size_t v = inline_table.var_first[i]; v < inline_table.var_first[i + 1]; v++)
+    vars_json.push_back(printVar(inline_var_table, v));
 
-  for (auto &addri : addresses) {
-    cur_lines.clear();
-    symtab->getSourceLines(cur_lines, addri);
-    if (cur_lines.empty()) continue;
+  json ranges_json = json::array();
+  for (size_t r = inline_table.range_first[i]; r < inline_table.range_first[i + 1]; r++)
+    ranges_json.push_back({{"start", inline_table.range_low[r]}, {"end", inline_table.range_high[r]}});
 
-    for (auto &fl : cur_lines)
-      unique_sourcefiles.insert(fl->getFile());
-  }
+  return {
+      {"name", nameRef(symbol(inline_table.name[i]))},
+      {"vars", vars_json},
+      {"ranges", ranges_json},
+      {"callsite_file", nameRef(symbol(inline_table.callsite_file[i]))},
+      {"callsite_line", inline_table.callsite_line[i]},
+  };
+}
 
+json printLoop(size_t i) {
+  json loop_json = json::object();
+  loop_json["name"] = symbol(loop_table.name[i]);
+  for (size_t e = loop_table.backedge_first[i]; e < loop_table.backedge_first[i + 1]; e++)
+    loop_json["backedges"].push_back(
+        edgeRef(loop_table.backedge_from[e], loop_table.backedge_to[e], "from", "to"));
+  for (auto &bi : rowsOf(loop_table.blocks, loop_table.block_first, i))
+    loop_json["blocks"].push_back(blockRef(bi));
+  for (size_t c = i + 1; c < loop_table.subtree_end[i]; c = loop_table.subtree_end[c])
+    loop_json["loops"].push_back(printLoop(c));
+  return loop_json;
+}
+
+// Reads only the tables, so it can run on several threads at once
+json printFunction(uint32_t fi) {
+  json basic_blocks = json::array();
+
+  json hidables = json::array();
+  // hidables
+  if (function_table.prologue_start[fi] != function_table.prologue_end[fi])
+    hidables.push_back({
+      {"start", function_table.prologue_start[fi]},
+      {"end", function_table.prologue_end[fi]},
+      {"name", "Function Entry"}
+    });
+
+  for (auto &bi : function_table.blocksOf(fi)) {
+    json basic_block = json::object();
+    // printBlockEntry
+    basic_block["id"] = blockRef(bi);
+    basic_block["start"] = block_table.start[bi];
+    basic_block["end"] = block_table.end[bi];
+
+    block_flag_set flags = block_table.flags[bi];
+    for (int i = bb_vectorized; i <= bb_fp; i++) {
+      if (!(flags & (1 << i))) continue;
+      switch (i) {
+        case bb_vectorized:
+          basic_block["flags"].push_back("vector");
+          break;
+        case bb_memory_read:
+          basic_block["flags"].push_back("memread");
+          break;
+        case bb_memory_write:
+          basic_block["flags"].push_back("memwrite");
+          break;
+        case bb_call:
+          basic_block["flags"].push_back("call");
+          break;
+        case bb_syscall:
+          basic_block["flags"].push_back("syscall");
+          break;
+        case bb_fp:
+          basic_block["flags"].push_back("fp");
+          break;
+      }
+    }
+
+    basic_blocks.push_back(basic_block);
+  }
+
+  // Both null when no symbol table function covers f, inlines also when
+  // nothing was inlined
+  json vars_json, inlines_json;
+  if (function_table.in_symtab[fi]) {
+    vars_json = json::array();
+    for (size_t v = function_table.var_first[fi]; v < function_table.var_first[fi + 1]; v++)
+      vars_json.push_back(printVar(var_table, v));
+    for (size_t i = function_table.inline_first[fi]; i < function_table.inline_first[fi + 1]; i++)
+      inlines_json.push_back(printInline(i));
+  }
+
+  // The top level loops, each followed by the rows nested in it
+  json loops_json;
+  for (size_t i = function_table.loop_first[fi]; i < function_table.loop_first[fi + 1];
+       i = loop_table.subtree_end[i])
+    loops_json.push_back(printLoop(i));
+
+  // printCalls
+  json calls_json = json::array();
+  for (size_t c = function_table.call_first[fi]; c < function_table.call_first[fi + 1]; c++) {
+    json call_json = json::object();
+    call_json["address"] = call_table.address[c];
+    call_json["target"] = call_table.target[c];
+
+    if (call_table.callee_first[c] != call_table.callee_first[c + 1]) {
+      json target_func_json = json::array();
+      for (auto &name : rowsOf(call_table.callee_name, call_table.callee_first, c))
+        target_func_json.push_back(nameRef(symbol(name)));
+      call_json["target_func"] = target_func_json;
+    }
+    calls_json.push_back(call_json);
+  }
+
+  return json::object({
+      {"name", nameRef(symbol(function_table.name[fi]))},
+      {"entry", function_table.entry[fi]},
+      {"basicblocks", basic_blocks},
+      {"vars", vars_json},
+      {"calls", calls_json},
+      {"inlines", inlines_json},
+      {"loops", loops_json},
+      {"hidables", hidables}
+  });
+}
+
+unsigned int getThreadCount(size_t work_items, size_t chunk_size) {
+  if (numThreads < 0) return 1;
+  unsigned int n = numThreads > 0 ? numThreads : thread::hardware_concurrency();
+  if (n == 0) n = 1;
+  size_t chunks = (work_items + chunk_size - 1) / chunk_size;
+  if (chunks < n) n = chunks > 0 ? chunks : 1;
+  return n;
+}
+
+void resolveNames(json &js, const vector<uint32_t> &remap) {
+  if (js.is_binary())
+    js = remap[placeholderIndex(js)];
+  else if (js.is_structured())
+    for (auto &v : js) resolveNames(v, remap);
+}
+
+WorkerPool::WorkerPool(unsigned int nthreads)
+    : job(nullptr), jobSize(0), jobChunk(1), next(0), generation(0), finished(0),
+      stopping(false) {
+  for (unsigned int tid = 1; tid < nthreads; tid++)
+    workers.push_back(thread(&WorkerPool::workLoop, this));
+}
+
+WorkerPool::~WorkerPool() {
+  {
+    lock_guard<mutex> guard(lock);
+    stopping = true;
+  }
+  wake.notify_all();
+  for (auto &t : workers) t.join();
+}
+
+void WorkerPool::drain() {
+  for (;;) {
+    size_t first = next.fetch_add(jobChunk);
+    if (first >= jobSize) break;
+    for (size_t i = first; i < min(first + jobChunk, jobSize); i++) (*job)(i);
+  }
+}
+
+void WorkerPool::workLoop() {
+  uint64_t seen = 0;
+  unique_lock<mutex> guard(lock);
+  for (;;) {
+    wake.wait(guard, [&] { return stopping || generation != seen; });
+    if (stopping) return;
+    seen = generation;
+    guard.unlock();
+    drain();
+    guard.lock();
+    if (++finished == workers.size()) done.notify_one();
+  }
+}
+
+void WorkerPool::run(size_t n, size_t chunk, const function<void(size_t)> &work) {
+  if (workers.empty()) {
+    for (size_t i = 0; i < n; i++) work(i);
+    return;
+  }
+  {
+    lock_guard<mutex> guard(lock);
+    job = &work;
+    jobSize = n;
+    jobChunk = chunk;
+    next = 0;
+    finished = 0;
+    generation++;
+  }
+  wake.notify_all();
+  drain();
+  unique_lock<mutex> guard(lock);
+  done.wait(guard, [&] { return finished == workers.size(); });
+  job = nullptr;
+}
+
+// printFunction for fs[begin, end), spread over the threads of pool. The
+// result, string_table included, is the same as calling it in a loop.
+vector<json> printFunctions(WorkerPool &pool, const FunctionList &fs, size_t begin, size_t end) {
+  size_t n = end - begin;
+  vector<json> out(n);
+  if (pool.size() == 1) {
+    for (size_t i = 0; i < n; i++) out[i] = printFunction(fs[begin + i]);
+    return out;
+  }
+
+  vector<StringTable> strings(compactNames ? n : 0);
+  auto run = [&](const function<void(size_t)> &work) { pool.run(n, PRINT_CHUNK_SIZE, work); };
+
+  run([&](size_t i) {
+    fragment_strings = compactNames ? &strings[i] : nullptr;
+    out[i] = printFunction(fs[begin + i]);
+    fragment_strings = nullptr;
+  });
+  if (!compactNames) return out;
+
+  // Each table lists its names in first use order, so interning them function
+  // by function reproduces the serial string_table
+  vector<vector<uint32_t> > remap(n);
+  for (size_t i = 0; i < n; i++)
+    for (auto &str : strings[i].strings)
+      remap[i].push_back(string_table.intern(str));
+  run([&](size_t i) { resolveNames(out[i], remap[i]); });
+  return out;
+}
+
+// lines are rows of line_table
+json buildParse(const FunctionList &fs, const vector<uint32_t> &lines) {
+  json js;
+  // Like writeParse(), nothing to write is a null document
+  if (fs.empty() && lines.empty()) return js;
+
+  // setBlockIds()
+  // unsigned long id = 0;
+  // for (auto &fun : funcs) {
+  //   ParseAPI::Function::blocklist blocks = fun->blocks();
+  //   for (const auto &i : blocks)
+  //     block_ids[i] = id++;
+  // }
+
+  // Functions are generated before lines so names are interned in the same
+  // order writeParse() writes them
+  string_table.clear();
+
+  // generateFunctionTable
+  WorkerPool pool(getThreadCount(fs.size(), PRINT_CHUNK_SIZE));
+  for (size_t w = 0; w < fs.size(); w += PRINT_WINDOW)
+    for (auto &f : printFunctions(pool, fs, w, min(w + PRINT_WINDOW, fs.size())))
+      js["functions"].push_back(move(f));
+
+  // generateLineInfo()
+  for (auto &li : lines)
+    js["lines"].push_back(printLine(li));
+
+  if (compactNames) js["strings"] = string_table.strings;
+  if (integerBlockIds) js["block_names"] = blockNames(fs);
+  return js;
+}
+
+void writeByte(ostream &out, uint8_t b) { out.put((char)b); }
+
+void writeBigEndian(ostream &out, uint64_t n, int bytes) {
+  for (int i = bytes - 1; i >= 0; i--) writeByte(out, (n >> (8 * i)) & 0xff);
+}
+
+// CBOR header of major type major (3 = text, 4 = array, 5 = map) holding n
+// items, using the shortest encoding like json::to_cbor does.
+void writeCborHeader(ostream &out, uint8_t major, uint64_t n) {
+  uint8_t m = major << 5;
+  if (n <= 0x17) {
+    writeByte(out, m | n);
+  } else if (n <= 0xff) {
+    writeByte(out, m | 24);
+    writeBigEndian(out, n, 1);
+  } else if (n <= 0xffff) {
+    writeByte(out, m | 25);
+    writeBigEndian(out, n, 2);
+  } else if (n <= 0xffffffff) {
+    writeByte(out, m | 26);
+    writeBigEndian(out, n, 4);
+  } else {
+    writeByte(out, m | 27);
+    writeBigEndian(out, n, 8);
+  }
+}
+
+// MessagePack header with the same size classes json::to_msgpack uses. fix
+// is the fixarray/fixmap/fixstr prefix and fix_max the largest count it holds.
+void writeMsgpackHeader(ostream &out, uint8_t fix, uint64_t fix_max,
+                        uint8_t code8, uint8_t code16, uint8_t code32,
+                        uint64_t n) {
+  if (n <= fix_max) {
+    writeByte(out, fix | n);
+  } else if (code8 && n <= 0xff) {
+    writeByte(out, code8);
+    writeBigEndian(out, n, 1);
+  } else if (n <= 0xffff) {
+    writeByte(out, code16);
+    writeBigEndian(out, n, 2);
+  } else {
+    writeByte(out, code32);
+    writeBigEndian(out, n, 4);
+  }
+}
+
+void writeObjectBegin(ostream &out, size_t n) {
+  if (outputFormat == fmt_cbor)
+    writeCborHeader(out, 5, n);
+  else if (outputFormat == fmt_msgpack)
+    writeMsgpackHeader(out, 0x80, 15, 0, 0xde, 0xdf, n);
+  else
+    out << '{';
+}
+
+void writeObjectEnd(ostream &out) {
+  if (outputFormat == fmt_json) out << '}';
+}
+
+void writeKey(ostream &out, const string &key, bool first) {
+  if (outputFormat == fmt_cbor) {
+    writeCborHeader(out, 3, key.size());
+    out << key;
+  } else if (outputFormat == fmt_msgpack) {
+    writeMsgpackHeader(out, 0xa0, 31, 0xd9, 0xda, 0xdb, key.size());
+    out << key;
+  } else {
+    if (!first) out << ',';
+    out << '"' << key << "\":";
+  }
+}
+
+void writeArrayBegin(ostream &out, size_t n) {
+  if (outputFormat == fmt_cbor)
+    writeCborHeader(out, 4, n);
+  else if (outputFormat == fmt_msgpack)
+    writeMsgpackHeader(out, 0x90, 15, 0, 0xdc, 0xdd, n);
+  else
+    out << '[';
+}
+
+void writeArrayEnd(ostream &out) {
+  if (outputFormat == fmt_json) out << ']';
+}
+
+void writeValue(ostream &out, const json &js, bool first = true) {
+  if (outputFormat == fmt_cbor) {
+    json::to_cbor(js, out);
+  } else if (outputFormat == fmt_msgpack) {
+    json::to_msgpack(js, out);
+  } else {
+    if (!first) out << ',';
+    out << js.dump();
+  }
+}
+
+string serialize(const json &js) {
+  stringstream out;
+  writeValue(out, js);
+  return out.str();
+}
+
+// Writes the same document as serialize(printParse()) one function at a time,
+// so only the largest function is ever held as a json DOM. Keys are written
+// in the order json objects sort them.
+void writeParse(ostream &out) {
+  FunctionList fs = allFunctions();
+  if (fs.empty() && line_table.empty()) {
+    writeValue(out, json());
+    return;
+  }
+
+  string_table.clear();
+  writeObjectBegin(out, integerBlockIds + !fs.empty() + !line_table.empty() + compactNames);
+  if (integerBlockIds) {
+    writeKey(out, "block_names", true);
+    writeValue(out, blockNames(fs));
+  }
+  if (!fs.empty()) {
+    writeKey(out, "functions", !integerBlockIds);
+    writeArrayBegin(out, fs.size());
+    // A window of functions is printed in parallel, then written in order
+    WorkerPool pool(getThreadCount(fs.size(), PRINT_CHUNK_SIZE));
+    for (size_t w = 0; w < fs.size(); w += PRINT_WINDOW) {
+      vector<json> window = printFunctions(pool, fs, w, min(w + PRINT_WINDOW, fs.size()));
+      for (size_t i = 0; i < window.size(); i++)
+        writeValue(out, window[i], w + i == 0);
+    }
+    writeArrayEnd(out);
+  }
+  if (!line_table.empty()) {
+    writeKey(out, "lines", !integerBlockIds && fs.empty());
+    writeArrayBegin(out, line_table.size());
+    for (size_t i = 0; i < line_table.size(); i++)
+      writeValue(out, printLine(i), i == 0);
+    writeArrayEnd(out);
+  }
+  // The table is complete only once everything else is written, which is
+  // also where the sorted key order puts it
+  if (compactNames) {
+    writeKey(out, "strings", false);
+    writeValue(out, string_table.strings);
+  }
+  writeObjectEnd(out);
+}
+
+// Calls emit with the edge_table row of every edge between blocks of fs.
+// Edges from blocks outside fs, such as calls from other functions, are left
+// out so the output only refers to blocks it declares. A block shared by
+// several functions contributes its edges once.
+template <typename F>
+void forEachEdge(const FunctionList &fs, F emit) {
+  if (fs.size() == function_table.size()) {
+    for (size_t e = 0; e < edge_table.size(); e++) emit(e);
+    return;
+  }
+
+  vector<bool> written(block_table.size(), false);
+  vector<uint32_t> order;
+  for (auto &fi : fs)
+    for (auto &bi : function_table.blocksOf(fi)) {
+      if (written[bi]) continue;
+      written[bi] = true;
+      order.push_back(bi);
+    }
+  for (auto &bi : order)
+    for (size_t e = edge_table.first[bi]; e < edge_table.first[bi + 1]; e++)
+      if (written[edge_table.source[e]]) emit(e);
+}
+
+bool intraprocedural(uint8_t type) { return type != CALL && type != RET; }
+
+// For each block, the block it would be merged with for --collapse: its
+// only intraprocedural successor, when it is that block's only
+// predecessor and that block is no function entry. npos otherwise.
+vector<uint32_t> chainLinks() {
+  const uint32_t npos = BlockTable::npos;
+  uint32_t n = block_table.size();
+  vector<uint32_t> nsucc(n, 0), npred(n, 0), succ(n, npos);
+  for (size_t e = 0; e < edge_table.size(); e++) {
+    if (!intraprocedural(edge_table.type[e])) continue;
+    nsucc[edge_table.source[e]]++;
+    npred[edge_table.target[e]]++;
+    succ[edge_table.source[e]] = edge_table.target[e];
+  }
+  unordered_set<Address> entries(function_table.entry.begin(), function_table.entry.end());
+
+  vector<uint32_t> links(n, npos);
+  for (uint32_t a = 0; a < n; a++) {
+    uint32_t b = succ[a];
+    if (nsucc[a] != 1 || b == a || npred[b] != 1) continue;
+    if (entries.find(block_table.start[b]) != entries.end()) continue;
+    links[a] = b;
+  }
+  return links;
+}
+
+// Straight-line chains merged into superblocks for --collapse, among the
+// blocks being written: a block joins its predecessor's superblock when
+// chainLinks() links them and both are written, so every member is written
+// along with its head. Left empty when not collapsing; a block that is not
+// a member of any superblock is its own.
+struct Superblocks {
+  vector<uint32_t> head;  // first block of each block's superblock
+  vector<uint32_t> next;  // following block in the same superblock, or npos
+  vector<uint32_t> members;  // blocks given to the last assign()
+  vector<bool> joined;       // members some other member links to
+
+  uint32_t headOf(uint32_t bi) const {
+    return head.empty() || head[bi] == BlockTable::npos ? bi : head[bi];
+  }
+  uint32_t after(uint32_t bi) const { return next.empty() ? BlockTable::npos : next[bi]; }
+
+  // True for the edges inside a superblock, which are not drawn
+  bool internal(uint32_t from, uint32_t to) const { return !next.empty() && next[from] == to; }
+
+  // Forms the superblocks of blocks, replacing those of the previous call.
+  // Only the rows that call set are reset, so one function at a time costs
+  // the size of the function.
+  template <typename Blocks>
+  void assign(const vector<uint32_t> &links, const Blocks &blocks) {
+    const uint32_t npos = BlockTable::npos, unassigned = npos - 1;
+    head.resize(links.size(), npos);
+    next.resize(links.size(), npos);
+    joined.resize(links.size(), false);
+    for (auto &bi : members) {
+      head[bi] = next[bi] = npos;
+      joined[bi] = false;
+    }
+    members.clear();
+    for (auto &bi : blocks)
+      if (head[bi] == npos) {
+        head[bi] = unassigned;
+        members.push_back(bi);
+      }
+
+    for (auto &a : members) {
+      uint32_t b = links[a];
+      if (b != npos && head[b] != npos) {
+        next[a] = b;
+        joined[b] = true;
+      }
+    }
+
+    auto chain = [&](uint32_t h) {
+      uint32_t b = h;
+      head[b] = h;
+      while (next[b] != npos && head[next[b]] == unassigned) {
+        b = next[b];
+        head[b] = h;
+      }
+      // Only a closed cycle runs into an assigned block; it is cut here
+      next[b] = npos;
+    };
+    for (auto &a : members)
+      if (!joined[a]) chain(a);
+    for (auto &a : members)
+      if (head[a] == unassigned) chain(a);
+  }
+};
+
+// The superblocks of the blocks of fs when collapsing, else none
+Superblocks superblocksFor(const FunctionList &fs) {
+  Superblocks sb;
+  if (!collapseBlocks) return sb;
+  vector<uint32_t> blocks;
+  for (auto &fi : fs)
+    for (auto &bi : function_table.blocksOf(fi)) blocks.push_back(bi);
+  sb.assign(chainLinks(), blocks);
+  return sb;
+}
+
+// Appends a in lower case hex, without a 0x prefix
+void writeHex(ostream &out, Address a) {
+  char digits[2 * sizeof(Address)];
+  char *p = digits + sizeof(digits);
+  do {
+    *--p = "0123456789abcdef"[a & 0xf];
+    a >>= 4;
+  } while (a);
+  out.write(p, digits + sizeof(digits) - p);
+}
+
+// Appends text with the characters a quoted DOT string treats specially
+// escaped
+void writeDOTText(ostream &out, const char *text) {
+  for (; *text; text++) {
+    if (*text == '"' || *text == '\\') out << '\\';
+    out << *text;
+  }
+}
+
+// Node ids are quoted: block names hold ": ", which Graphviz would otherwise
+// read as a port, and templates bring in <, >, ( and ,
+void writeDOTBlockId(ostream &out, uint32_t bi) {
+  out << "\"B";
+  writeDOTText(out, block_table.nameText(bi));
+  out << '"';
+}
+
+// Writes the CFG of fs to out as it goes. Nothing is flushed here, so the
+// stream's buffer alone decides when data reaches the file. With
+// --dot-clusters the blocks of each function form a cluster subgraph, so
+// Graphviz lays out every function on its own.
+void writeDOTGraph(ostream &out, const FunctionList &fs) {
+  Superblocks sb = superblocksFor(fs);
+  out << "digraph g {\n";
+
+  for (auto &fi : fs) {
+    if (function_table.blocksOf(fi).empty()) continue;
+    const string &fname = symbol(function_table.name[fi]);
+    if (dotClusters) {
+      out << "subgraph cluster_";
+      writeHex(out, function_table.entry[fi]);
+      out << " {\nlabel=\"" << fname << "\";\n";
+    }
+
+    for (auto &bi : function_table.blocksOf(fi)) {
+      if (sb.headOf(bi) != bi) continue;
+
+      // Set the basic block label to: function_name\n[instruction list]
+      writeDOTBlockId(out, bi);
+      out << " [shape=box, style=solid, label=\"" << fname;
+      size_t count = 0;
+      for (uint32_t m = bi; m != BlockTable::npos; m = sb.after(m)) {
+        size_t insn_end = block_table.insn[m] + block_table.ninsns[m];
+        Address a = block_table.start[m];
+        for (size_t k = block_table.insn[m]; k < insn_end; a += insn_table.length[k++]) {
+          out << "\\n0x";
+          writeHex(out, a);
+          out << ": ";
+          writeDOTText(out, insn_table.textOf(k));
+        }
+        count += block_table.ninsns[m];
+      }
+      if (count == 0) out << "\\n";
+      out << '"';
+      // A superblock keeps the ranges of the blocks it was made of
+      if (collapseBlocks) {
+        out << ", ranges=\"";
+        for (uint32_t m = bi; m != BlockTable::npos; m = sb.after(m)) {
+          if (m != bi) out << ' ';
+          out << "0x";
+          writeHex(out, block_table.start[m]);
+          out << "-0x";
+          writeHex(out, block_table.end[m]);
+        }
+        out << '"';
+      }
+      out << "];\n";
+    }
+    if (dotClusters) out << "}\n";
+  }
+
+  forEachEdge(fs, [&](size_t e) {
+    uint32_t from = edge_table.source[e], to = edge_table.target[e];
+    if (sb.internal(from, to)) return;
+    writeDOTBlockId(out, sb.headOf(from));
+    out << " -> ";
+    writeDOTBlockId(out, sb.headOf(to));
+    out << " [style=solid, color=\"black\"];\n";
+  });
+  out << "}\n\n";
+}
+
+string buildDOT(const FunctionList &fs) {
+  ostringstream out;
+  writeDOTGraph(out, fs);
+  return out.str();
+}
+
+string block_to_name(const ParseAPI::Function *fn, const ParseAPI::Block *block, const int cur_id) {
+  // Only the function part is cleaned, so a shortened name still reads
+  // "<function>: B<n>" with the same function name as everywhere else
+  return print_clean_string(fn->name()) + ": B" + itos(cur_id);
+}
+
+void scanBlock(ParseAPI::Function *f, const Block *block,
+               InstructionDecoder &decoder, block_flag_set &flags,
+               InsnTable &insns) {
+  Address icur = block->start();
+  Address iend = block->last();
+  while (icur <= iend) {
+    const unsigned char *raw_insnptr =
+        (const unsigned char *)f->isrc()->getPtrToInstruction(icur);
+#if defined(DYNINST_MAJOR_VERSION) && (DYNINST_MAJOR_VERSION >= 10)
+    Instruction instr = decoder.decode(raw_insnptr);
+#else
+    Instruction::Ptr ip = decoder.decode(raw_insnptr);
+    Instruction instr = *ip;
+#endif
+    insns.push(instr);
+    icur += instr.size();
+    setBlockFlags(block, instr, flags);
+  }
+}
+
+bool statementBefore(const Statement::Ptr &a, const Statement::Ptr &b) {
+  if (a->startAddr() != b->startAddr()) return a->startAddr() < b->startAddr();
+  if (a->endAddr() != b->endAddr()) return a->endAddr() < b->endAddr();
+  if (a->getLine() != b->getLine()) return a->getLine() < b->getLine();
+  return a->getFile() < b->getFile();
+}
+
+// Appends to out every row of lines (with its reach built) that covers an
+// instruction of block bi. Only the rows overlapping the block are looked at,
+// found by binary search; starts is scratch space.
+void linesOfBlock(const LineTable &lines, uint32_t bi, vector<Address> &starts,
+                  vector<uint32_t> &out) {
+  size_t lo = upper_bound(lines.reach.begin(), lines.reach.end(), block_table.start[bi]) -
+              lines.reach.begin();
+  size_t hi = lower_bound(lines.from.begin(), lines.from.end(), block_table.end[bi]) -
+              lines.from.begin();
+  if (lo >= hi) return;
+  insnStarts(bi, starts);
+  for (size_t i = lo; i < hi; i++) {
+    auto it = lower_bound(starts.begin(), starts.end(), lines.from[i]);
+    if (it != starts.end() && *it < lines.to[i]) out.push_back(i);
+  }
+}
+
+bool allFunctionsRequested() {
+  return functionNames.size() == 0 || (functionNames.size() == 1 && functionNames[0] == "null");
+}
+
+// The modules whose statements can cover decoded code: all of them after a
+// whole-program decode, otherwise only those holding a decoded block, so a
+// targeted decode does not read the line table of the whole binary
+vector<Module *> lineModules() {
+  vector<Module *> mods;
+  if (allFunctionsRequested()) {
+    symtab->getAllModules(mods);
+    return mods;
+  }
+  set<Module *> found, at;
+  for (uint32_t bi = 0; bi < block_table.size(); bi++) {
+    at.clear();
+    if (symtab->findModuleByOffset(at, block_table.start[bi]))
+      found.insert(at.begin(), at.end());
+  }
+  return vector<Module *>(found.begin(), found.end());
+}
+
+// Fills line_table with every statement that covers at least one decoded
+// instruction. The line table of each module is read once and sorted by
+// address, then searched block by block, which gives the same statements as
+// calling getSourceLines() for every address.
+void resolveLines() {
+  vector<Module *> mods = lineModules();
+
+  vector<Statement::Ptr> statements;
+  for (auto &mod : mods) {
+    vector<Statement::Ptr> mod_statements;
+    mod->getStatements(mod_statements);
+    statements.insert(statements.end(), mod_statements.begin(), mod_statements.end());
+  }
+  sort(statements.begin(), statements.end(), statementBefore);
+
+  LineTable all;
+  for (auto &st : statements)
+    all.push(symbols.intern(st->getFile()), st->getLine(), st->startAddr(), st->endAddr());
+  all.buildReach();
+  vector<uint32_t> rows;
+  vector<Address> starts;
+  for (uint32_t bi = 0; bi < block_table.size(); bi++) linesOfBlock(all, bi, starts, rows);
+  sort(rows.begin(), rows.end());
+  rows.erase(unique(rows.begin(), rows.end()), rows.end());
+  // Paths are cleaned like those of variables and inlines, but kept whole
+  unordered_map<uint32_t, uint32_t> cleaned;
+  for (auto &i : rows) {
+    auto file = cleaned.find(all.file[i]);
+    if (file == cleaned.end())
+      file = cleaned.emplace(all.file[i], symbols.intern(clean_path(symbol(all.file[i])))).first;
+    line_table.push(file->second, all.line[i], all.from[i], all.to[i]);
+  }
+}
+
+void sortFunctionsByEntry() {
+  funcs_by_entry = allFunctions();
+  stable_sort(funcs_by_entry.begin(), funcs_by_entry.end(), [](uint32_t a, uint32_t b) {
+    return function_table.entry[a] < function_table.entry[b];
+  });
+}
+
+// The files line_table refers to, as printSourceFiles() lists them
+void collectSourceFiles() {
+  for (auto &file : line_table.file) unique_sourcefiles.insert(symbol(file));
+}
+
+// Parse only the entry points of the requested functions, then follow their
+// call edges breadth first until callDepth levels of callees are parsed.
+set<Address> parseTargeted(CodeObject *co) {
+  set<Address> parsed;
+  vector<Address> frontier;
+  for (auto &name : functionNames) {
+    vector<SymtabAPI::Function *> found;
+    if (!symtab->findFunctionsByName(found, name)) {
+      cerr << "Warning: function " << name << " not found in symbol table" << endl;
+      continue;
+    }
+    for (auto &sf : found) frontier.push_back(sf->getOffset());
+  }
+
+  for (int depth = 0; !frontier.empty(); depth++) {
+    set<Address> level;
+    for (auto &addr : frontier)
+      if (parsed.insert(addr).second) {
+        co->parse(addr, false);
+        level.insert(addr);
+      }
+    frontier.clear();
+    if (depth >= callDepth) break;
+
+    for (auto &f : co->funcs()) {
+      if (level.find(f->addr()) == level.end()) continue;
+      for (auto &edge : f->callEdges()) {
+        Block *to = edge->trg();
+        if (!to || to->start() == (Address)-1) continue;
+        if (parsed.find(to->start()) == parsed.end())
+          frontier.push_back(to->start());
+      }
+    }
+  }
+  return parsed;
+}
+
+void clearDecodeState() {
+  for(auto &b: block_table.block) delete b;
+  block_table.clear();
+  insn_table.clear();
+  edge_table.clear();
+  block_index.clear();
+  symbols.clear();
+  function_table.clear();
+  var_table.clear();
+  inline_table.clear();
+  inline_var_table.clear();
+  loop_table.clear();
+  call_table.clear();
+  block_loops.clear();
+  loops_resolved.clear();
+  block_funcs_first.clear();
+  block_funcs.clear();
+  line_table.clear();
+  if(symtab) {
+    delete symtab;
+    symtab = nullptr;
+  }
+  funcs.clear();
+  funcs_by_entry.clear();
+  unique_sourcefiles.clear();
+  curr_block_id = 0;
+  parseSeconds = 0;
+}
+
+int decodeBinary(const string binaryPath) {
+  // Clear previous states
+  clearDecodeState();
+
+  bool isParsable = SymtabAPI::Symtab::openFile(symtab, binaryPath);
+  if (!isParsable) {
+    cerr << "Error: file " << binaryPath << " can not be parsed" << endl;
+    return -1;
+  }
+  SymtabCodeSource *sts =
+      new SymtabCodeSource(const_cast<char *>(binaryPath.c_str()));
+  CodeObject *co = new CodeObject(sts);
+
+  // Dyninst parses in parallel through OpenMP, so the thread count has to be
+  // set on the shared OpenMP runtime before parse() starts its workers.
+  // Without one, the team the runtime started with (OMP_NUM_THREADS or every
+  // core) is put back in case an earlier decode changed it.
+#ifdef _OPENMP
+  static const int defaultParseThreads = omp_get_max_threads();
+  unsigned int parseThreads = defaultParseThreads;
+  if (numThreads > 0)
+    parseThreads = numThreads;
+  else if (numThreads == 0 && thread::hardware_concurrency() > 0)
+    parseThreads = thread::hardware_concurrency();
+  omp_set_num_threads(parseThreads);
+#endif
+  bool targeted = targetedParse && !allFunctionsRequested();
+  set<Address> entries;
+  auto parseStart = chrono::steady_clock::now();
+  if (targeted)
+    entries = parseTargeted(co);
+  else
+    co->parse();
+  parseSeconds = chrono::duration<double>(chrono::steady_clock::now() - parseStart).count();
+
+  if (allFunctionsRequested()) {
+    funcs = co->funcs();
+  } else if (targeted) {
+    // Callees pulled in by --call-depth are kept alongside the named functions
+    for (auto &func : co->funcs())
+      if (entries.find(func->addr()) != entries.end())
+        funcs.insert(func);
+  } else {
+    for (auto &func : co->funcs())
+      if (find(functionNames.begin(), functionNames.end(), func->name()) != functionNames.end())
+        funcs.insert(func);
+  }
+  if (funcs.empty()) {
+    cerr << "Error: no functions in file" << endl;
+    return -1;
+  }
+
+  // Every (function, block) pair in the order the serial scan visits them,
+  // with the function's row. Workers write into their own slot so the merge
+  // below is deterministic.
+  vector<pair<ParseAPI::Function *, Block *> > work;
+  vector<uint32_t> work_func;
+  uint32_t fi = 0;
+  for (auto &f : funcs) {
+    for (const auto &block : f->blocks()) {
+      work.push_back(make_pair(f, block));
+      work_func.push_back(fi);
+    }
+    fi++;
+  }
+
+  // A block shared by several functions is scanned on its first visit only,
+  // the one the merge below keeps
+  vector<bool> work_scan(work.size());
+  {
+    unordered_set<const Block *> seen;
+    for (size_t i = 0; i < work.size(); i++) work_scan[i] = seen.insert(work[i].second).second;
+  }
+
+  vector<block_flag_set> work_flags(work.size(), 0);
+  unsigned int nthreads = getThreadCount(work.size(), SCAN_CHUNK_SIZE);
+  vector<InsnTable> thread_insns(nthreads);
+  // Which thread scanned each work item and the rows it added to that
+  // thread's instruction buffer
+  vector<unsigned int> work_thread(work.size());
+  vector<pair<size_t, size_t> > work_insns(work.size());
+  atomic<size_t> next_work(0);
+
+  auto worker = [&](unsigned int tid) {
+    // create an Instruction decoder which will convert the binary opcodes to
+    // strings
+    ParseAPI::Function *anyfunc = *funcs.begin();
+    InstructionDecoder decoder(
+        anyfunc->isrc()->getPtrToInstruction(anyfunc->addr()),
+        InstructionDecoder::maxInstructionLength, anyfunc->region()->getArch());
+
+    for (;;) {
+      size_t begin = next_work.fetch_add(SCAN_CHUNK_SIZE);
+      if (begin >= work.size()) break;
+      size_t end = min(begin + SCAN_CHUNK_SIZE, work.size());
+      for (size_t i = begin; i < end; i++) {
+        if (!work_scan[i]) continue;
+        size_t first_insn = thread_insns[tid].size();
+        scanBlock(work[i].first, work[i].second, decoder, work_flags[i],
+                  thread_insns[tid]);
+        work_thread[i] = tid;
+        work_insns[i] = make_pair(first_insn, thread_insns[tid].size());
+      }
+    }
+  };
+
+  if (nthreads == 1) {
+    worker(0);
+  } else {
+    vector<thread> threads;
+    for (unsigned int tid = 0; tid < nthreads; tid++)
+      threads.push_back(thread(worker, tid));
+    for (auto &t : threads) t.join();
+  }
+
+  // With one thread the buffer already holds every block's rows in order and
+  // becomes the table as is; otherwise the rows are copied over block by block.
+  bool single = nthreads == 1;
+  if (single) swap(insn_table, thread_insns[0]);
+
+  // Names are handed out serially so ids match a single-threaded run. A block
+  // shared by several functions keeps the name from the last one.
+  for (size_t i = 0; i < work.size(); i++) {
+    ParseAPI::Function *f = work[i].first;
+    Block *block = work[i].second;
+
+    bool inserted;
+    uint32_t bi = block_table.insert(block, inserted);
+    if (inserted) {
+      size_t count = work_insns[i].second - work_insns[i].first;
+      block_table.flags[bi] = work_flags[i];
+      block_table.insn[bi] = single ? work_insns[i].first : insn_table.size();
+      block_table.ninsns[bi] = count;
+      if (!single) insn_table.append(thread_insns[work_thread[i]], work_insns[i].first, count);
+    }
+    block_table.func[bi] = work_func[i];
+    block_table.number[bi] = curr_block_id;
+    block_table.setName(bi, block_to_name(f, block, curr_block_id++));
+  }
+  // Free the per-thread buffers before the function and line passes
+  vector<InsnTable>().swap(thread_insns);
+  edge_table.build(block_table);
+  block_index.build(block_table);
+  extractFunctions();
+
+  sortFunctionsByEntry();
+
+  resolveLines();
+  line_table.buildReach();
+  collectSourceFiles();
   return 0;
 }
 
-json getAssembly() {
+// All functions must be called after this one. With a cache directory the
+// tables come from the cache when they are there, and every output is then
+// built from them without opening the binary.
+int decode(const string binaryPath) {
+  cacheKey = cacheDir.empty() ? "" : computeCacheKey(binaryPath);
+
+  if (!cacheKey.empty()) {
+    clearDecodeState();
+    if (loadCachedTables()) {
+      block_index.build(block_table);
+      sortFunctionsByEntry();
+      line_table.buildReach();
+      collectSourceFiles();
+      return 0;
+    }
+  }
+
+  int ret = decodeBinary(binaryPath);
+  if (ret == 0 && !cacheKey.empty()) storeCachedTables();
+  return ret;
+}
+
+json buildAssembly(const FunctionList &fs) {
   json res = {
     {"blocks", json::array()},
     {"links", json::array()}
   };
+  string_table.clear();
+  Superblocks sb = superblocksFor(fs);
 
-  for (auto &f : funcs) {
-    if (f->blocks().empty()) continue;
-
-    for (const auto &block : f->blocks()) {
-      ParseAPI::Block::Insns insns;
-      block->getInsns(insns);
+  for (auto &fi : fs) {
+    for (auto &bi : function_table.blocksOf(fi)) {
+      if (sb.headOf(bi) != bi) continue;
 
       json blockJson = {
-        {"name",block_ids[block]},
+        {"name", blockRef(bi)},
         {"instructions", json::array()},
-        {"function_name", print_clean_string(f->name())}
+        {"function_name", nameRef(symbol(function_table.name[fi]))}
       };
-      for (auto &instr : insns)
-        blockJson["instructions"].push_back({
-          {"address", instr.first},
-          {"instruction", instr.second.format()}
-        });
+      for (uint32_t m = bi; m != BlockTable::npos; m = sb.after(m)) {
+        size_t insn_end = block_table.insn[m] + block_table.ninsns[m];
+        Address a = block_table.start[m];
+        for (size_t k = block_table.insn[m]; k < insn_end; a += insn_table.length[k++])
+          blockJson["instructions"].push_back({
+            {"address", a},
+            {"instruction", insn_table.textOf(k)}
+          });
+        // A superblock keeps the blocks it was made of
+        if (collapseBlocks)
+          blockJson["blocks"].push_back({
+            {"id", blockRef(m)},
+            {"start", block_table.start[m]},
+            {"end", block_table.end[m]}
+          });
+      }
       res["blocks"].push_back(blockJson);
     }
   }
 
-  for (auto &f : funcs) {
-    for (const auto &block: f->blocks()) {
-      for (auto &edge : block->sources()) {
-        auto sourcei = block_ids.find(edge->src());
-        auto targeti = block_ids.find(edge->trg());
-        if (sourcei == block_ids.end() || targeti == block_ids.end()) continue;
-        res["links"].push_back({
-          {"source", sourcei->second},
-          {"target", targeti->second}
-        });
+  forEachEdge(fs, [&](size_t e) {
+    uint32_t from = edge_table.source[e], to = edge_table.target[e];
+    if (sb.internal(from, to)) return;
+    res["links"].push_back(edgeRef(sb.headOf(from), sb.headOf(to), "source", "target"));
+  });
+  if (compactNames) res["strings"] = string_table.strings;
+  if (integerBlockIds) res["block_names"] = blockNames(fs);
+  return res;
+}
+
+// Whole-program call graph over funcs_by_entry. Calls from a function are
+// rows first[i] to first[i + 1] of callee/calls, one row per distinct
+// callee. Strongly connected components come from Tarjan's algorithm,
+// which numbers them callees first, so a topological order of the condensed
+// graph (callers first) is the reverse of their ids.
+struct CallGraph {
+  vector<size_t> first;
+  vector<uint32_t> callee;
+  vector<uint32_t> calls;  // call sites behind the edge
+  vector<uint32_t> scc;    // component of each function
+  vector<vector<uint32_t> > sccs;
+  vector<bool> recursive;  // component has a cycle, including self calls
+};
+
+CallGraph computeCallGraph() {
+  CallGraph cg;
+  uint32_t n = funcs_by_entry.size();
+  vector<uint32_t> node(function_table.size());
+  for (uint32_t i = 0; i < n; i++) node[funcs_by_entry[i]] = i;
+
+  // row[j] is the row of the current caller's edge to j, so repeated calls
+  // only bump its count
+  vector<size_t> row(n, (size_t)-1);
+  for (uint32_t i = 0; i < n; i++) {
+    cg.first.push_back(cg.callee.size());
+    uint32_t fi = funcs_by_entry[i];
+    for (size_t c = function_table.call_first[fi]; c < function_table.call_first[fi + 1]; c++) {
+      for (auto &t : rowsOf(call_table.callee, call_table.callee_first, c)) {
+        if (t == FunctionTable::npos) continue;
+        uint32_t j = node[t];
+        if (row[j] != (size_t)-1 && row[j] >= cg.first[i]) {
+          cg.calls[row[j]]++;
+          continue;
+        }
+        row[j] = cg.callee.size();
+        cg.callee.push_back(j);
+        cg.calls.push_back(1);
+      }
+    }
+  }
+  cg.first.push_back(cg.callee.size());
+
+  // Iterative Tarjan, so deep call chains cannot overflow the stack
+  const uint32_t unvisited = (uint32_t)-1;
+  vector<uint32_t> order(n, unvisited), low(n);
+  cg.scc.assign(n, unvisited);
+  vector<uint32_t> stack;
+  vector<pair<uint32_t, size_t> > walk;  // function and its next row
+  uint32_t counter = 0;
+  for (uint32_t root = 0; root < n; root++) {
+    if (order[root] != unvisited) continue;
+    order[root] = low[root] = counter++;
+    stack.push_back(root);
+    walk.push_back(make_pair(root, cg.first[root]));
+
+    while (!walk.empty()) {
+      uint32_t v = walk.back().first;
+      size_t &r = walk.back().second;
+      if (r < cg.first[v + 1]) {
+        uint32_t w = cg.callee[r++];
+        if (order[w] == unvisited) {
+          order[w] = low[w] = counter++;
+          stack.push_back(w);
+          walk.push_back(make_pair(w, cg.first[w]));
+        } else if (cg.scc[w] == unvisited) {
+          low[v] = min(low[v], order[w]);
+        }
+        continue;
+      }
+
+      walk.pop_back();
+      if (!walk.empty()) {
+        uint32_t parent = walk.back().first;
+        low[parent] = min(low[parent], low[v]);
+      }
+      if (low[v] != order[v]) continue;
+
+      uint32_t id = cg.sccs.size();
+      cg.sccs.push_back(vector<uint32_t>());
+      uint32_t w;
+      do {
+        w = stack.back();
+        stack.pop_back();
+        cg.scc[w] = id;
+        cg.sccs[id].push_back(w);
+      } while (w != v);
+      sort(cg.sccs[id].begin(), cg.sccs[id].end());
+
+      bool cycle = cg.sccs[id].size() > 1;
+      for (size_t e = cg.first[v]; !cycle && e < cg.first[v + 1]; e++)
+        cycle = cg.callee[e] == v;
+      cg.recursive.push_back(cycle);
+    }
+  }
+  return cg;
+}
+
+json buildCallGraph(const CallGraph &cg) {
+  json res = {
+    {"nodes", json::array()},
+    {"edges", json::array()},
+    {"sccs", json::array()},
+    {"order", json::array()}
+  };
+  string_table.clear();
+
+  for (uint32_t i = 0; i < funcs_by_entry.size(); i++)
+    res["nodes"].push_back({
+      {"name", nameRef(symbol(function_table.name[funcs_by_entry[i]]))},
+      {"entry", function_table.entry[funcs_by_entry[i]]},
+      {"scc", cg.scc[i]}
+    });
+  for (uint32_t i = 0; i < funcs_by_entry.size(); i++)
+    for (size_t e = cg.first[i]; e < cg.first[i + 1]; e++)
+      res["edges"].push_back({{"caller", i}, {"callee", cg.callee[e]}, {"calls", cg.calls[e]}});
+  for (size_t c = 0; c < cg.sccs.size(); c++)
+    res["sccs"].push_back({{"functions", cg.sccs[c]}, {"recursive", (bool)cg.recursive[c]}});
+  for (size_t c = cg.sccs.size(); c > 0; c--)
+    res["order"].push_back(c - 1);
+
+  if (compactNames) res["strings"] = string_table.strings;
+  return res;
+}
+
+// The call graph in DOT. Functions of a recursive component share a cluster.
+void writeCallGraphDOT(ostream &out, const CallGraph &cg) {
+  out << "digraph callgraph {\n";
+  for (size_t c = 0; c < cg.sccs.size(); c++) {
+    if (cg.recursive[c]) out << "subgraph cluster_scc" << c << " {\nlabel=\"scc " << c << "\";\n";
+    for (auto &i : cg.sccs[c])
+      out << 'F' << i << " [shape=box, label=\"" << symbol(function_table.name[funcs_by_entry[i]]) << "\"];\n";
+    if (cg.recursive[c]) out << "}\n";
+  }
+  for (uint32_t i = 0; i < funcs_by_entry.size(); i++)
+    for (size_t e = cg.first[i]; e < cg.first[i + 1]; e++)
+      out << 'F' << i << " -> F" << cg.callee[e] << " [label=\"" << cg.calls[e] << "\"];\n";
+  out << "}\n\n";
+}
+
+// Adds the back edges of every loop of fi, as pairs of superblock heads
+void collectBackEdges(uint32_t fi, const Superblocks &sb, set<pair<uint32_t, uint32_t> > &back) {
+  size_t first = loop_table.backedge_first[function_table.loop_first[fi]];
+  size_t last = loop_table.backedge_first[function_table.loop_first[fi + 1]];
+  for (size_t e = first; e < last; e++) {
+    uint32_t from = loop_table.backedge_from[e], to = loop_table.backedge_to[e];
+    if (from != BlockTable::npos && to != BlockTable::npos)
+      back.insert(make_pair(sb.headOf(from), sb.headOf(to)));
+  }
+}
+
+// Layered layout of the CFG of function fi. Boxes are sized for the DOT label, the
+// function name over one line per instruction, and loop back edges point
+// up. Coordinates are whole pixels.
+json layoutFunction(uint32_t fi, const Superblocks &sb) {
+  const string &fname = symbol(function_table.name[fi]);
+  LayoutGraph g;
+  vector<uint32_t> nodes;
+  unordered_map<uint32_t, uint32_t> local;
+  for (auto &bi : function_table.blocksOf(fi)) {
+    if (sb.headOf(bi) != bi || local.count(bi)) continue;
+    local[bi] = nodes.size();
+    nodes.push_back(bi);
+
+    size_t lines = 1, chars = fname.size();
+    for (uint32_t m = bi; m != BlockTable::npos; m = sb.after(m)) {
+      size_t insn_end = block_table.insn[m] + block_table.ninsns[m];
+      Address a = block_table.start[m];
+      for (size_t k = block_table.insn[m]; k < insn_end; a += insn_table.length[k++]) {
+        // "0x<address>: <instruction>"
+        size_t digits = 1;
+        for (Address rest = a; rest >= 16; rest >>= 4) digits++;
+        chars = max(chars, 4 + digits + strlen(insn_table.textOf(k)));
       }
+      lines += block_table.ninsns[m];
+    }
+    g.width.push_back(chars * LAYOUT_CHAR_WIDTH + 2 * LAYOUT_PADDING);
+    g.height.push_back(lines * LAYOUT_LINE_HEIGHT + 2 * LAYOUT_PADDING);
+  }
+
+  set<pair<uint32_t, uint32_t> > back;
+  collectBackEdges(fi, sb, back);
+
+  // Intraprocedural edges between blocks of f, one per pair of superblocks
+  set<pair<uint32_t, uint32_t> > seen;
+  for (auto &bi : nodes)
+    for (uint32_t m = bi; m != BlockTable::npos; m = sb.after(m))
+      for (size_t e = edge_table.first[m]; e < edge_table.first[m + 1]; e++) {
+        uint32_t from = edge_table.source[e];
+        if (!intraprocedural(edge_table.type[e]) || sb.internal(from, m)) continue;
+        auto src = local.find(sb.headOf(from));
+        if (src == local.end()) continue;
+        auto key = make_pair(sb.headOf(from), bi);
+        if (!seen.insert(key).second) continue;
+        g.edges.push_back(make_pair(src->second, local[bi]));
+        g.back.push_back(back.find(key) != back.end());
+      }
+
+  Layout layout = layoutGraph(g);
+
+  json res = {
+    {"name", nameRef(fname)},
+    {"entry", function_table.entry[fi]},
+    {"nodes", json::array()},
+    {"edges", json::array()}
+  };
+  for (size_t i = 0; i < nodes.size(); i++)
+    res["nodes"].push_back({
+      {"id", blockRef(nodes[i])},
+      {"x", lround(layout.x[i])},
+      {"y", lround(layout.y[i])},
+      {"width", lround(g.width[i])},
+      {"height", lround(g.height[i])},
+      {"layer", layout.layer[i]}
+    });
+  for (size_t e = 0; e < g.edges.size(); e++) {
+    json points = json::array();
+    for (auto &p : layout.points[e])
+      points.push_back({lround(p.first), lround(p.second)});
+    res["edges"].push_back({
+      {"from", blockRef(nodes[g.edges[e].first])},
+      {"to", blockRef(nodes[g.edges[e].second])},
+      {"back", (bool)layout.back[e]},
+      {"points", points}
+    });
+  }
+  return res;
+}
+
+json buildLayout(const FunctionList &fs) {
+  json res = {{"functions", json::array()}};
+  string_table.clear();
+  // Each function is collapsed on its own, its blocks being all it draws
+  Superblocks sb;
+  vector<uint32_t> links;
+  if (collapseBlocks) links = chainLinks();
+
+  for (auto &fi : fs) {
+    if (function_table.blocksOf(fi).empty()) continue;
+    if (collapseBlocks) sb.assign(links, function_table.blocksOf(fi));
+    res["functions"].push_back(layoutFunction(fi, sb));
+  }
+
+  if (compactNames) res["strings"] = string_table.strings;
+  if (integerBlockIds) res["block_names"] = blockNames(fs);
+  return res;
+}
+
+// All rows of line_table
+vector<uint32_t> allLines() {
+  vector<uint32_t> lines(line_table.size());
+  for (uint32_t i = 0; i < lines.size(); i++) lines[i] = i;
+  return lines;
+}
+
+json printParse() { return buildParse(allFunctions(), allLines()); }
+
+void streamParse(ostream &out) { writeParse(out); }
+
+void visitParse(const function<bool(const json &)> &onFunction,
+                const function<bool(const json &)> &onLine) {
+  for (uint32_t fi = 0; fi < function_table.size(); fi++)
+    if (!onFunction(printFunction(fi))) return;
+  for (size_t i = 0; i < line_table.size(); i++)
+    if (!onLine(printLine(i))) return;
+}
+
+FdStreamBuf::FdStreamBuf(int fd, size_t size) : fd(fd), buffer(size) {
+  setp(buffer.data(), buffer.data() + buffer.size());
+}
+
+FdStreamBuf::~FdStreamBuf() { sync(); }
+
+bool FdStreamBuf::flushBuffer() {
+  const char *p = pbase();
+  while (p < pptr()) {
+    ssize_t n = ::write(fd, p, pptr() - p);
+    if (n < 0) {
+      if (errno == EINTR) continue;
+      return false;
+    }
+    p += n;
+  }
+  setp(buffer.data(), buffer.data() + buffer.size());
+  return true;
+}
+
+FdStreamBuf::int_type FdStreamBuf::overflow(int_type ch) {
+  if (!flushBuffer()) return traits_type::eof();
+  if (!traits_type::eq_int_type(ch, traits_type::eof())) {
+    *pptr() = traits_type::to_char_type(ch);
+    pbump(1);
+  }
+  return traits_type::not_eof(ch);
+}
+
+int FdStreamBuf::sync() { return flushBuffer() ? 0 : -1; }
+
+CompressStreamBuf::CompressStreamBuf(streambuf *sink, compression method, size_t size)
+    : sink(sink), method(method), size(size), buffer(size), out(size), zstd(nullptr),
+      gzReady(false), closing(false), finished(false), failed(false) {
+  if (method == comp_zstd) {
+    zstd = ZSTD_createCCtx();
+    failed = !zstd;
+  } else {
+    memset(&gz, 0, sizeof(gz));
+    // 16 added to the window bits asks zlib for a gzip header and trailer
+    gzReady = deflateInit2(&gz, Z_DEFAULT_COMPRESSION, Z_DEFLATED, 15 + 16, 8,
+                           Z_DEFAULT_STRATEGY) == Z_OK;
+    failed = !gzReady;
+  }
+  setp(buffer.data(), buffer.data() + buffer.size());
+  worker = thread(&CompressStreamBuf::compressLoop, this);
+}
+
+CompressStreamBuf::~CompressStreamBuf() {
+  finish();
+  if (method == comp_zstd)
+    ZSTD_freeCCtx(zstd);  // accepts null
+  else if (gzReady)
+    deflateEnd(&gz);
+}
+
+// Queues the buffered bytes for the compressor thread, waiting while it is
+// COMPRESS_QUEUE_DEPTH buffers behind
+bool CompressStreamBuf::handOff(bool last) {
+  buffer.resize(pptr() - pbase());
+  {
+    unique_lock<mutex> guard(lock);
+    cond.wait(guard, [&]() { return pending.size() < COMPRESS_QUEUE_DEPTH || failed; });
+    if (failed && !last) return false;
+    pending.push_back(move(buffer));
+    closing = last;
+  }
+  cond.notify_all();
+
+  buffer.assign(last ? 0 : size, 0);
+  setp(buffer.data(), buffer.data() + buffer.size());
+  return true;
+}
+
+void CompressStreamBuf::compressLoop() {
+  for (;;) {
+    vector<char> chunk;
+    bool last;
+    {
+      unique_lock<mutex> guard(lock);
+      cond.wait(guard, [&]() { return !pending.empty(); });
+      chunk = move(pending.front());
+      pending.pop_front();
+      last = closing && pending.empty();
+    }
+    cond.notify_all();
+
+    if (!compressChunk(chunk, last)) {
+      lock_guard<mutex> guard(lock);
+      failed = true;
+    }
+    if (last) break;
+  }
+  cond.notify_all();
+}
+
+bool CompressStreamBuf::writeSink(const char *data, size_t n) {
+  return sink->sputn(data, n) == (streamsize)n;
+}
+
+bool CompressStreamBuf::compressChunk(const vector<char> &chunk, bool last) {
+  if (failed) return false;
+
+  if (method == comp_zstd) {
+    ZSTD_inBuffer in = {chunk.data(), chunk.size(), 0};
+    ZSTD_EndDirective mode = last ? ZSTD_e_end : ZSTD_e_continue;
+    for (;;) {
+      ZSTD_outBuffer o = {out.data(), out.size(), 0};
+      size_t remaining = ZSTD_compressStream2(zstd, &o, &in, mode);
+      if (ZSTD_isError(remaining) || !writeSink(out.data(), o.pos)) return false;
+      if (last ? remaining == 0 : in.pos == in.size) return true;
     }
   }
+
+  gz.next_in = (Bytef *)chunk.data();
+  gz.avail_in = chunk.size();
+  do {
+    gz.next_out = (Bytef *)out.data();
+    gz.avail_out = out.size();
+    if (deflate(&gz, last ? Z_FINISH : Z_NO_FLUSH) == Z_STREAM_ERROR) return false;
+    if (!writeSink(out.data(), out.size() - gz.avail_out)) return false;
+  } while (gz.avail_out == 0);
+  return true;
+}
+
+CompressStreamBuf::int_type CompressStreamBuf::overflow(int_type ch) {
+  if (finished || !handOff(false)) return traits_type::eof();
+  if (!traits_type::eq_int_type(ch, traits_type::eof())) {
+    *pptr() = traits_type::to_char_type(ch);
+    pbump(1);
+  }
+  return traits_type::not_eof(ch);
+}
+
+bool CompressStreamBuf::finish() {
+  if (!finished) {
+    finished = true;
+    handOff(true);
+    worker.join();
+    sink->pubsync();
+  }
+  return !failed;
+}
+
+bool writeOutput(streambuf *sink, const function<void(ostream &)> &write) {
+  if (outputCompression == comp_none) {
+    ostream out(sink);
+    write(out);
+    return out.flush().good();
+  }
+
+  CompressStreamBuf buf(sink, outputCompression);
+  ostream out(&buf);
+  write(out);
+  return out.good() && buf.finish();
+}
+
+string writeDOT() { return buildDOT(allFunctions()); }
+
+void streamDOT(ostream &out) { writeDOTGraph(out, allFunctions()); }
+
+// Creates path and fills it through writeOutput(), with one large buffer
+// between the writer and the file
+bool writeFile(const string &path, const function<void(ostream &)> &write) {
+  int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0) return false;
+  bool ok;
+  {
+    FdStreamBuf buf(fd);
+    ok = writeOutput(&buf, write);
+  }
+  return close(fd) == 0 && ok;
+}
+
+json getAssembly() { return buildAssembly(allFunctions()); }
+
+json getLayout() { return buildLayout(allFunctions()); }
+
+json printCallGraph() { return buildCallGraph(computeCallGraph()); }
+
+string writeCallGraphDOT() {
+  ostringstream out;
+  writeCallGraphDOT(out, computeCallGraph());
+  return out.str();
+}
+
+// Decoded functions whose entry address is in entries, in funcs order
+FunctionList functionsAt(const vector<Address> &entries) {
+  set<Address> wanted(entries.begin(), entries.end());
+  FunctionList fs;
+  for (uint32_t fi = 0; fi < function_table.size(); fi++)
+    if (wanted.find(function_table.entry[fi]) != wanted.end()) fs.push_back(fi);
+  return fs;
+}
+
+// The part of line_table that covers instructions of fs, found block by
+// block like resolveLines() does
+vector<uint32_t> linesFor(const FunctionList &fs) {
+  vector<uint32_t> lines;
+  vector<Address> starts;
+  for (auto &fi : fs)
+    for (auto &bi : function_table.blocksOf(fi)) linesOfBlock(line_table, bi, starts, lines);
+  sort(lines.begin(), lines.end());
+  lines.erase(unique(lines.begin(), lines.end()), lines.end());
+  return lines;
+}
+
+bool hasFunctionAt(Address entry) {
+  auto it = lower_bound(funcs_by_entry.begin(), funcs_by_entry.end(), entry,
+                        [](uint32_t fi, Address a) { return function_table.entry[fi] < a; });
+  return it != funcs_by_entry.end() && function_table.entry[*it] == entry;
+}
+
+// Names are compared as listFunctions() prints them, cleaned and shortened
+vector<Address> functionEntries(const string &name) {
+  vector<Address> entries;
+  for (uint32_t fi = 0; fi < function_table.size(); fi++)
+    if (symbol(function_table.name[fi]) == name) entries.push_back(function_table.entry[fi]);
+  return entries;
+}
+
+uint64_t loopKey(uint32_t fi, uint32_t bi) { return (uint64_t)fi << 32 | bi; }
+
+// Fills block_loops for the blocks of loop row i of function fi and the
+// loops nested in it. path holds the loops around it, and a nested loop
+// comes later so its blocks end up with the longest path.
+void resolveLoops(uint32_t fi, size_t i, vector<string> &path) {
+  path.push_back(symbol(loop_table.name[i]));
+  for (auto &bi : rowsOf(loop_table.blocks, loop_table.block_first, i)) {
+    if (bi == BlockTable::npos) continue;
+    vector<string> &loops = block_loops[loopKey(fi, bi)];
+    if (loops.size() < path.size()) loops = path;
+  }
+  for (size_t c = i + 1; c < loop_table.subtree_end[i]; c = loop_table.subtree_end[c])
+    resolveLoops(fi, c, path);
+  path.pop_back();
+}
+
+// Inverts function_table.blocks into block_funcs, in function row order
+void buildBlockFunctions() {
+  block_funcs_first.assign(block_table.size() + 1, 0);
+  for (auto &bi : function_table.blocks) block_funcs_first[bi + 1]++;
+  for (size_t bi = 0; bi < block_table.size(); bi++)
+    block_funcs_first[bi + 1] += block_funcs_first[bi];
+  block_funcs.resize(function_table.blocks.size());
+  vector<size_t> fill(block_funcs_first.begin(), block_funcs_first.end() - 1);
+  for (uint32_t fi = 0; fi < function_table.size(); fi++)
+    for (auto &bi : function_table.blocksOf(fi)) block_funcs[fill[bi]++] = fi;
+}
+
+// The loops around block bi in function fi, outermost first
+json loopsAround(uint32_t fi, uint32_t bi) {
+  if (loops_resolved.insert(fi).second) {
+    vector<string> path;
+    for (size_t i = function_table.loop_first[fi]; i < function_table.loop_first[fi + 1];
+         i = loop_table.subtree_end[i])
+      resolveLoops(fi, i, path);
+  }
+  auto loops = block_loops.find(loopKey(fi, bi));
+  return loops == block_loops.end() ? json::array() : json(loops->second);
+}
+
+// The statement of line_table covering a, among those starting last before
+// it, or null
+json lineAt(Address a) {
+  const vector<Address> &from = line_table.from;
+  size_t i = upper_bound(from.begin(), from.end(), a) - from.begin();
+  if (i == 0) return json();
+  Address first = from[i - 1];
+  json line;
+  for (; i > 0 && from[i - 1] == first; i--)
+    if (a < line_table.to[i - 1])
+      line = {{"file", symbol(line_table.file[i - 1])},
+              {"line", line_table.line[i - 1]}};
+  return line;
+}
+
+json lookupAddress(Address a) {
+  uint32_t bi = block_index.find(a);
+  if (bi == BlockTable::npos) return json();
+
+  // A block shared by several functions is reported for each of them
+  if (block_funcs_first.empty()) buildBlockFunctions();
+  json functions = json::array();
+  for (auto &fi : rowsOf(block_funcs, block_funcs_first, bi))
+    functions.push_back({
+      {"name", symbol(function_table.name[fi])},
+      {"entry", function_table.entry[fi]},
+      {"loops", loopsAround(fi, bi)}
+    });
+
+  return {
+    {"address", a},
+    {"functions", functions},
+    {"block", block_table.nameOf(bi)},
+    {"block_index", bi},
+    {"block_start", block_table.start[bi]},
+    {"block_end", block_table.end[bi]},
+    {"source", lineAt(a)}
+  };
+}
+
+json lookupAddresses(const vector<Address> &addrs) {
+  json res = json::array();
+  for (auto &a : addrs) res.push_back(lookupAddress(a));
   return res;
 }
 
+// Entries of the function given on the command line by name or by address
+vector<Address> parseFunctionArg(const string &arg) {
+  char *end;
+  Address addr = strtoul(arg.c_str(), &end, 0);
+  if (!arg.empty() && *end == '\0') return vector<Address>(1, addr);
+  return functionEntries(arg);
+}
+
+// Position in funcs_by_entry of the first function with entry at or above a
+size_t entryLowerBound(Address a) {
+  return lower_bound(funcs_by_entry.begin(), funcs_by_entry.end(), a,
+                     [](uint32_t fi, Address a) { return function_table.entry[fi] < a; }) -
+         funcs_by_entry.begin();
+}
+
+// Position in funcs_by_entry where the page after cursor starts
+size_t pageStart(const PageCursor &cursor) {
+  if (!cursor.resume) return 0;
+  if (cursor.counted)
+    return min(entryLowerBound(cursor.after) + cursor.count, funcs_by_entry.size());
+  return upper_bound(funcs_by_entry.begin(), funcs_by_entry.end(), cursor.after,
+                     [](Address a, uint32_t fi) { return a < function_table.entry[fi]; }) -
+         funcs_by_entry.begin();
+}
+
+// One page of the function table in entry address order: the functions from
+// cursor on, skipping offset and keeping at most limit of them (0 keeps all).
+FunctionList functionPage(size_t offset, size_t limit, const PageCursor &cursor) {
+  size_t first = pageStart(cursor);
+  size_t available = funcs_by_entry.size() - first;
+  if (offset >= available) return FunctionList();
+  first += offset;
+  size_t count = limit == 0 ? available - offset : min(limit, available - offset);
+  return FunctionList(funcs_by_entry.begin() + first, funcs_by_entry.begin() + first + count);
+}
+
+bool pageRequested(size_t offset, size_t limit, const PageCursor &cursor) {
+  return offset != 0 || limit != 0 || cursor.resume;
+}
+
+json listFunctions(size_t offset, size_t limit, const PageCursor &cursor) {
+  json list = json::array();
+
+  FunctionList fs = pageRequested(offset, limit, cursor)
+                        ? functionPage(offset, limit, cursor)
+                        : allFunctions();
+  for (auto &fi : fs) {
+    Address size = 0;
+    for (auto &bi : function_table.blocksOf(fi)) size += block_table.end[bi] - block_table.start[bi];
+    list.push_back({
+        {"name", symbol(function_table.name[fi])},
+        {"entry", function_table.entry[fi]},
+        {"size", size},
+    });
+  }
+  return list;
+}
+
+json printParseFunctions(const vector<Address> &entries) {
+  FunctionList fs = functionsAt(entries);
+  return buildParse(fs, linesFor(fs));
+}
+
+// A page of printParse entries plus the cursor for the next page: the
+// [entry, count] pair to pass as after, counting the functions at that entry
+// the page already holds, or null on the last page
+json printParsePage(size_t offset, size_t limit, const PageCursor &cursor) {
+  size_t first = min(pageStart(cursor) + offset, funcs_by_entry.size());
+  FunctionList fs = functionPage(offset, limit, cursor);
+  size_t end = first + fs.size();
+
+  json js = buildParse(fs, linesFor(fs));
+  if (js.is_null()) js = {{"functions", json::array()}};
+  if (fs.empty() || end == funcs_by_entry.size()) {
+    js["next"] = json();
+  } else {
+    Address entry = function_table.entry[fs.back()];
+    js["next"] = {entry, end - entryLowerBound(entry)};
+  }
+  js["total"] = funcs_by_entry.size();
+  return js;
+}
+
+string writeDOTFunctions(const vector<Address> &entries) {
+  return buildDOT(functionsAt(entries));
+}
+
+json getAssemblyFunctions(const vector<Address> &entries) {
+  return buildAssembly(functionsAt(entries));
+}
+
+json getLayoutFunctions(const vector<Address> &entries) {
+  return buildLayout(functionsAt(entries));
+}
+
 int main(int argc, char **argv) {
   parseArgs(argc, argv);
 
-  if(!decode(binaryPath)) return -1;
+  if(decode(binaryPath) != 0) return -1;
+  cerr << "Parse time: " << parseSeconds << "s" << endl;
+
+  if (listFunctionsOnly) {
+    cout << serialize(listFunctions(pageOffset, pageLimit, pageCursor));
+    return 0;
+  }
+
+  if (!lookupAddrs.empty()) {
+    cout << serialize(lookupAddresses(lookupAddrs));
+    return 0;
+  }
+
+  if (!dotFunction.empty()) {
+    FunctionList fs = functionsAt(parseFunctionArg(dotFunction));
+    if (fs.empty()) {
+      cerr << "Error: no function " << dotFunction << endl;
+      return 1;
+    }
+    return writeOutput(cout.rdbuf(), [&](ostream &out) { writeDOTGraph(out, fs); }) ? 0 : 1;
+  }
 
   const char *last_slash = strrchr(binaryPath.c_str(), '/');
   string filename;
@@ -684,13 +3109,39 @@ int main(int argc, char **argv) {
   else
     filename = binaryPath;
 
-  ofstream jsonf(filename + ".json");
-  jsonf << printParse().dump();
-  jsonf.close();
-
-  ofstream dotf(filename + ".dot");
-  dotf << writeDOT();
-  dotf.close();
+  bool ok = writeFile(filename + outputExtension() + compressionExtension(), [](ostream &out) {
+    if (!entryAddresses.empty())
+      out << serialize(printParseFunctions(entryAddresses));
+    else if (pageRequested(pageOffset, pageLimit, pageCursor))
+      out << serialize(printParsePage(pageOffset, pageLimit, pageCursor));
+    else
+      streamParse(out);
+  });
+
+  ok = writeFile(filename + ".dot" + compressionExtension(), [](ostream &out) {
+    if (!entryAddresses.empty())
+      writeDOTGraph(out, functionsAt(entryAddresses));
+    else if (pageRequested(pageOffset, pageLimit, pageCursor))
+      writeDOTGraph(out, functionPage(pageOffset, pageLimit, pageCursor));
+    else
+      streamDOT(out);
+  }) && ok;
+
+  if (layoutOutput)
+    ok = writeFile(filename + ".layout" + outputExtension() + compressionExtension(), [](ostream &out) {
+      out << serialize(entryAddresses.empty() ? getLayout() : getLayoutFunctions(entryAddresses));
+    }) && ok;
+
+  if (callGraphOutput) {
+    ok = writeFile(filename + ".callgraph" + outputExtension() + compressionExtension(),
+                   [](ostream &out) { out << serialize(printCallGraph()); }) && ok;
+    ok = writeFile(filename + ".callgraph.dot" + compressionExtension(),
+                   [](ostream &out) { out << writeCallGraphDOT(); }) && ok;
+  }
 
+  if (!ok) {
+    cerr << "Error: writing the output files failed" << endl;
+    return 1;
+  }
   return 0;
 }
\ No newline at end of file
@@ -2,26 +2,210 @@
 #define SIMPLEOPT
 
 
+#include <elf.h>
+#include <fcntl.h>
 #include <signal.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <deque>
 #include <fstream>
+#include <functional>
+#include <iomanip>
 #include <iostream>
 #include <map>
-#include <regex>
+#include <mutex>
 #include <set>
+#include <streambuf>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
 
 #include <CodeObject.h>
 #include <Function.h>
 #include <InstructionDecoder.h>
 #include <Symtab.h>
 
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#include <zlib.h>
+#include <zstd.h>
+
 #include <json.hpp>
 #include "includes/cxxopts.hpp"
+#include "sanitize.h"
+#include "layout.h"
+
+typedef enum {
+  comp_none,
+  comp_gzip,
+  comp_zstd
+} compression;
+
+extern int numThreads;
+extern std::vector<std::string> functionNames;
+extern bool targetedParse;
+extern int callDepth;
+extern std::string cacheDir;
+extern double parseSeconds;
+extern bool compactNames;
+extern bool integerBlockIds;
+extern compression outputCompression;
+extern bool dotClusters;
+extern bool collapseBlocks;
+
+bool setOutputFormat(const std::string &);
+bool setCompression(const std::string &);
+const char *compressionExtension();
+// Runs write on a stream into sink, compressed as chosen with
+// setCompression(). Returns false when writing failed.
+bool writeOutput(std::streambuf *sink, const std::function<void(std::ostream &)> &write);
+std::string serialize(const nlohmann::json &);
 
 int decode(std::string);
 nlohmann::json printParse();
+void streamParse(std::ostream &);
+// Hands every "functions" entry and then every "lines" entry of the
+// printParse() document to the callbacks, building one json DOM at a time.
+// A callback returning false stops the walk.
+void visitParse(const std::function<bool(const nlohmann::json &)> &onFunction,
+                const std::function<bool(const nlohmann::json &)> &onLine);
 std::string writeDOT();
+// Layered layout of every CFG: node boxes and edge polylines, in pixels
+nlohmann::json getLayout();
+// Writes the writeDOT() graph to the stream as it is generated
+void streamDOT(std::ostream &);
 nlohmann::json printSourceFiles();
 nlohmann::json getAssembly();
+// Whole-program call graph: functions, call edges weighted by call sites,
+// strongly connected components and a topological order of them
+nlohmann::json printCallGraph();
+std::string writeCallGraphDOT();
+
+// Where a page of functions in entry address order starts. Without resume
+// it is the first function. Otherwise it is the first one whose entry is
+// above after, or with counted set, the one count places past the first
+// whose entry is at or above after. The second form is what pages hand out
+// as next, so functions sharing an entry are never skipped.
+struct PageCursor {
+  bool resume;
+  Dyninst::Address after;
+  bool counted;
+  size_t count;
+
+  PageCursor() : resume(false), after(0), counted(false), count(0) {}
+};
+
+// Per-function access to the decoded state
+nlohmann::json listFunctions(size_t offset = 0, size_t limit = 0,
+                             const PageCursor &cursor = PageCursor());
+nlohmann::json printParsePage(size_t offset, size_t limit, const PageCursor &cursor);
+bool hasFunctionAt(Dyninst::Address entry);
+std::vector<Dyninst::Address> functionEntries(const std::string &name);
+nlohmann::json printParseFunctions(const std::vector<Dyninst::Address> &entries);
+std::string writeDOTFunctions(const std::vector<Dyninst::Address> &entries);
+nlohmann::json getAssemblyFunctions(const std::vector<Dyninst::Address> &entries);
+nlohmann::json getLayoutFunctions(const std::vector<Dyninst::Address> &entries);
+// For each address: the block, every function holding it with the loops
+// around the block in that function (outermost first), and the source line,
+// or null when no decoded block covers it
+nlohmann::json lookupAddresses(const std::vector<Dyninst::Address> &addrs);
+
+// Output buffer that writes straight to a file descriptor, flushing only
+// when the buffer is full or on sync().
+class FdStreamBuf : public std::streambuf {
+ public:
+  explicit FdStreamBuf(int fd, size_t size = 1 << 20);
+  ~FdStreamBuf();
+
+ protected:
+  int_type overflow(int_type ch);
+  int sync();
+
+ private:
+  bool flushBuffer();
+
+  int fd;
+  std::vector<char> buffer;
+};
+
+// Output buffer that gzip or zstd compresses everything written to it into
+// sink. Full buffers are compressed on a separate thread while the caller
+// carries on producing the next one.
+class CompressStreamBuf : public std::streambuf {
+ public:
+  CompressStreamBuf(std::streambuf *sink, compression method, size_t size = 1 << 20);
+  ~CompressStreamBuf();
+
+  // Ends the compressed stream and waits for it to reach sink. Returns false
+  // when compressing or writing to sink failed.
+  bool finish();
+
+ protected:
+  int_type overflow(int_type ch);
+
+ private:
+  bool handOff(bool last);
+  void compressLoop();
+  bool compressChunk(const std::vector<char> &chunk, bool last);
+  bool writeSink(const char *data, size_t n);
+
+  std::streambuf *sink;
+  compression method;
+  size_t size;
+  std::vector<char> buffer;
+  std::vector<char> out;
+  z_stream gz;
+  ZSTD_CCtx *zstd;
+  bool gzReady;  // deflateInit2 succeeded, so gz needs deflateEnd
+
+  // Filled buffers waiting for the compressor thread
+  std::deque<std::vector<char> > pending;
+  bool closing;
+  bool finished;
+  bool failed;
+  std::mutex lock;
+  std::condition_variable cond;
+  std::thread worker;
+};
+
+// Threads kept alive for a whole document, so printFunctions() does not start
+// and join a set of threads for every window. run() hands the indexes of
+// [0, n) out in chunks to the workers and the calling thread and returns once
+// all of them are done.
+class WorkerPool {
+ public:
+  explicit WorkerPool(unsigned int nthreads);
+  ~WorkerPool();
+
+  // The calling thread counts as one
+  unsigned int size() const { return workers.size() + 1; }
+  void run(size_t n, size_t chunk, const std::function<void(size_t)> &work);
+
+ private:
+  void workLoop();
+  void drain();
+
+  std::vector<std::thread> workers;
+  const std::function<void(size_t)> *job;
+  size_t jobSize;
+  size_t jobChunk;
+  std::atomic<size_t> next;
+  // Bumped for every run(); each worker takes part in every generation
+  uint64_t generation;
+  unsigned int finished;
+  bool stopping;
+  std::mutex lock;
+  std::condition_variable wake;
+  std::condition_variable done;
+};
 
 #endif
\ No newline at end of file
@@ -8,53 +8,717 @@
 #include "simpleopt.h"
 
 
+#include <fcntl.h>
 #include <iostream>
+#include <unordered_map>
 
-static PyObject *method_decode(PyObject *self, PyObject *args) {
+static PyObject *method_decode(PyObject *self, PyObject *args, PyObject *kwargs) {
     char *binaryFilePath = NULL;
+    int threads = -1;
+    PyObject *functions = NULL;
+    int targeted = 0;
+    int depth = 0;
+    const char *cache = NULL;
+    static const char *kwlist[] = {"binary", "threads", "functions", "targeted", "call_depth", "cache_dir", NULL};
 
     /* Parse arguments */
-    if(!PyArg_ParseTuple(args, "s", &binaryFilePath)) {
+    if(!PyArg_ParseTupleAndKeywords(args, kwargs, "s|iOpiz", const_cast<char **>(kwlist),
+                                    &binaryFilePath, &threads, &functions, &targeted, &depth, &cache)) {
         return NULL;
     }
+    cacheDir = cache ? cache : "";
+    numThreads = threads;
+    targetedParse = targeted;
+    callDepth = depth;
 
-    if(!decode(binaryFilePath))
+    functionNames.clear();
+    if(functions && functions != Py_None) {
+        PyObject *seq = PySequence_Fast(functions, "functions must be a list of names");
+        if(!seq) return NULL;
+        for(Py_ssize_t i = 0; i < PySequence_Fast_GET_SIZE(seq); i++) {
+            const char *name = PyUnicode_AsUTF8(PySequence_Fast_GET_ITEM(seq, i));
+            if(!name) {
+                Py_DECREF(seq);
+                return NULL;
+            }
+            functionNames.push_back(name);
+        }
+        Py_DECREF(seq);
+    }
+
+    if(decode(binaryFilePath) != 0)
         // TODO: Throw python exception here
         return PyLong_FromLong(-1);
 
     return PyLong_FromLong(0);
 }
 
-static PyObject *method_printParse(PyObject *self, PyObject *args) {
+static PyObject *method_getParseTime(PyObject *self, PyObject *args) {
+    return PyFloat_FromDouble(parseSeconds);
+}
+
+static void resetOutputOptions() {
+    setOutputFormat("json");
+    setCompression("none");
+    compactNames = false;
+    integerBlockIds = false;
+    dotClusters = false;
+    collapseBlocks = false;
+}
+
+/* Selects the output format for one call; binary is set for cbor/msgpack.
+   On an error every option goes back to its default, so the next call does
+   not inherit what this one had already set. */
+static bool setFormat(const char *format, bool &binary) {
+    if(!setOutputFormat(format)) {
+        PyErr_Format(PyExc_ValueError, "unknown format '%s', expected json, cbor or msgpack", format);
+        resetOutputOptions();
+        return false;
+    }
+    binary = strcmp(format, "json") != 0;
+    return true;
+}
+
+/* Selects the compression for one call; None leaves the result uncompressed.
+   Resets the options on an error, like setFormat. */
+static bool setCompress(const char *compress) {
+    if(setCompression(compress ? compress : "none")) return true;
+    PyErr_Format(PyExc_ValueError, "unknown compression '%s', expected gzip or zstd", compress);
+    resetOutputOptions();
+    return false;
+}
 
-    std::string ret = printParse().dump();
+/* Runs write through the selected compression, into bytes. Like writeDest
+   it keeps the GIL, the compressor thread does not need it. */
+static PyObject *compressResult(const std::function<void(std::ostream &)> &write) {
+    std::stringbuf sink;
+    bool ok = writeOutput(&sink, write);
+    resetOutputOptions();
+    if(!ok) {
+        PyErr_SetString(PyExc_RuntimeError, "compressing the output failed");
+        return NULL;
+    }
+    std::string ret = sink.str();
+    return PyBytes_FromStringAndSize(ret.data(), ret.size());
+}
+
+/* Serializes js in the selected format, as str for json and bytes otherwise
+   or when compressed */
+static PyObject *formatResult(const nlohmann::json &js, bool binary) {
+    if(outputCompression != comp_none)
+        return compressResult([&](std::ostream &out) { out << serialize(js); });
+
+    std::string ret = serialize(js);
+    resetOutputOptions();
+    if(binary)
+        return PyBytes_FromStringAndSize(ret.data(), ret.size());
     return PyUnicode_FromString(ret.c_str());
 }
 
-static PyObject *method_printSourceFiles(PyObject *self, PyObject *args) {
+/* Adds the entry address of one function given by address or name, raising
+   ValueError when no decoded function matches */
+static bool appendEntry(PyObject *item, std::vector<Dyninst::Address> &entries) {
+    if(PyLong_Check(item)) {
+        Dyninst::Address entry = PyLong_AsUnsignedLong(item);
+        if(PyErr_Occurred()) return false;
+        if(!hasFunctionAt(entry)) {
+            PyErr_Format(PyExc_ValueError, "no function at %#lx", (unsigned long)entry);
+            return false;
+        }
+        entries.push_back(entry);
+        return true;
+    }
+    if(PyUnicode_Check(item)) {
+        const char *name = PyUnicode_AsUTF8(item);
+        if(!name) return false;
+        std::vector<Dyninst::Address> named = functionEntries(name);
+        if(named.empty()) {
+            PyErr_Format(PyExc_ValueError, "no function named '%s'", name);
+            return false;
+        }
+        entries.insert(entries.end(), named.begin(), named.end());
+        return true;
+    }
+    PyErr_SetString(PyExc_TypeError, "functions are given by entry address or name");
+    return false;
+}
+
+/* Accepts one function or a list of them */
+static bool parseEntries(PyObject *functions, std::vector<Dyninst::Address> &entries) {
+    if(PyLong_Check(functions) || PyUnicode_Check(functions))
+        return appendEntry(functions, entries);
+
+    PyObject *seq = PySequence_Fast(functions, "functions must be an address, a name or a list of them");
+    if(!seq) return false;
+    bool ok = true;
+    for(Py_ssize_t i = 0; ok && i < PySequence_Fast_GET_SIZE(seq); i++)
+        ok = appendEntry(PySequence_Fast_GET_ITEM(seq, i), entries);
+    Py_DECREF(seq);
+    return ok;
+}
+
+static const char *formatKwlist[] = {"format", "compact", "int_block_ids", "compress", NULL};
+
+static PyObject *method_printParse(PyObject *self, PyObject *args, PyObject *kwargs) {
+    const char *format = "json";
+    int compact = 0;
+    int intBlockIds = 0;
+    const char *compress = NULL;
+    bool binary;
+
+    if(!PyArg_ParseTupleAndKeywords(args, kwargs, "|sppz", const_cast<char **>(formatKwlist),
+                                    &format, &compact, &intBlockIds, &compress)) {
+        return NULL;
+    }
+    if(!setFormat(format, binary) || !setCompress(compress)) return NULL;
+    compactNames = compact;
+    integerBlockIds = intBlockIds;
+
+    // Compressed output is streamed, so the document is compressed while it
+    // is still being generated
+    if(outputCompression != comp_none)
+        return compressResult([](std::ostream &out) { streamParse(out); });
+    return formatResult(printParse(), binary);
+}
+
+/* Converts json values to Python objects. Object keys repeat for every
+   block and line, so each distinct key is interned once per conversion. */
+class PyConverter {
+public:
+    ~PyConverter() {
+        for(auto &key : keys) Py_DECREF(key.second);
+    }
+
+    PyObject *convert(const nlohmann::json &js) {
+        switch(js.type()) {
+        case nlohmann::json::value_t::boolean:
+            return PyBool_FromLong(js.get<bool>());
+        case nlohmann::json::value_t::number_integer:
+            return PyLong_FromLongLong(js.get<long long>());
+        case nlohmann::json::value_t::number_unsigned:
+            return PyLong_FromUnsignedLongLong(js.get<unsigned long long>());
+        case nlohmann::json::value_t::number_float:
+            return PyFloat_FromDouble(js.get<double>());
+        case nlohmann::json::value_t::string: {
+            const std::string &str = js.get_ref<const std::string &>();
+            return PyUnicode_DecodeUTF8(str.data(), str.size(), "replace");
+        }
+        case nlohmann::json::value_t::array: {
+            PyObject *list = PyList_New(js.size());
+            if(!list) return NULL;
+            Py_ssize_t i = 0;
+            for(auto &item : js) {
+                PyObject *value = convert(item);
+                if(!value) {
+                    Py_DECREF(list);
+                    return NULL;
+                }
+                PyList_SET_ITEM(list, i++, value);
+            }
+            return list;
+        }
+        case nlohmann::json::value_t::object: {
+            PyObject *dict = PyDict_New();
+            if(!dict) return NULL;
+            for(auto it = js.begin(); it != js.end(); ++it) {
+                PyObject *key = internKey(it.key());
+                PyObject *value = key ? convert(it.value()) : NULL;
+                if(!value || PyDict_SetItem(dict, key, value) < 0) {
+                    Py_XDECREF(value);
+                    Py_DECREF(dict);
+                    return NULL;
+                }
+                Py_DECREF(value);
+            }
+            return dict;
+        }
+        default:
+            Py_RETURN_NONE;
+        }
+    }
+
+    /* Appends the converted value to list */
+    bool append(PyObject *list, const nlohmann::json &js) {
+        PyObject *value = convert(js);
+        if(!value) return false;
+        int ret = PyList_Append(list, value);
+        Py_DECREF(value);
+        return ret == 0;
+    }
+
+private:
+    PyObject *internKey(const std::string &key) {
+        auto found = keys.find(key);
+        if(found != keys.end()) return found->second;
+        PyObject *str = PyUnicode_InternFromString(key.c_str());
+        if(str) keys[key] = str;
+        return str;
+    }
+
+    std::unordered_map<std::string, PyObject *> keys;
+};
+
+/* Builds the get_json document as Python objects, one function at a time */
+static PyObject *method_getParseObj(PyObject *self, PyObject *args) {
+    PyConverter converter;
+    PyObject *functions = PyList_New(0);
+    PyObject *lines = PyList_New(0);
+    if(!functions || !lines) {
+        Py_XDECREF(functions);
+        Py_XDECREF(lines);
+        return NULL;
+    }
+
+    bool failed = false;
+    visitParse(
+        [&](const nlohmann::json &entry) {
+            failed = !converter.append(functions, entry);
+            return !failed;
+        },
+        [&](const nlohmann::json &entry) {
+            failed = !converter.append(lines, entry);
+            return !failed;
+        });
+    PyObject *result = failed ? NULL : PyDict_New();
+    if(result) {
+        /* Same keys as printParse(), which leaves out empty arrays */
+        if((PyList_GET_SIZE(functions) && PyDict_SetItemString(result, "functions", functions) < 0) ||
+           (PyList_GET_SIZE(lines) && PyDict_SetItemString(result, "lines", lines) < 0))
+            Py_CLEAR(result);
+        else if(PyDict_Size(result) == 0) {
+            Py_DECREF(result);
+            result = Py_None;
+            Py_INCREF(result);
+        }
+    }
+    Py_DECREF(functions);
+    Py_DECREF(lines);
+    return result;
+}
+
+static PyObject *method_getSourceFilesObj(PyObject *self, PyObject *args) {
+    return PyConverter().convert(printSourceFiles());
+}
+
+static PyObject *method_getAssemblyObj(PyObject *self, PyObject *args) {
+    return PyConverter().convert(getAssembly());
+}
+
+/* Opens dest, a path or a file descriptor, for writing; ownsFd is set when
+   the caller has to close it */
+static bool openDest(PyObject *dest, const char *method, int &fd, bool &ownsFd) {
+    ownsFd = false;
+    if(PyLong_Check(dest)) {
+        fd = PyLong_AsLong(dest);
+        return !PyErr_Occurred();
+    }
+    if(PyUnicode_Check(dest)) {
+        fd = open(PyUnicode_AsUTF8(dest), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if(fd < 0) {
+            PyErr_SetFromErrnoWithFilenameObject(PyExc_OSError, dest);
+            return false;
+        }
+        ownsFd = true;
+        return true;
+    }
+    PyErr_Format(PyExc_TypeError, "%s expects a path or a file descriptor", method);
+    return false;
+}
+
+/* Streams write into fd through the selected compression. The GIL stays
+   held: the writers read the decoded tables and the output options, which
+   another thread's decode() or option arguments would change underneath. */
+static PyObject *writeDest(int fd, bool ownsFd, const std::function<void(std::ostream &)> &write) {
+    bool ok;
+    {
+        FdStreamBuf buf(fd);
+        ok = writeOutput(&buf, write);
+    }
+    if(ownsFd) close(fd);
+    resetOutputOptions();
+
+    if(!ok) return PyErr_SetFromErrno(PyExc_OSError);
+    Py_RETURN_NONE;
+}
+
+static PyObject *method_writeJson(PyObject *self, PyObject *args, PyObject *kwargs) {
+    PyObject *dest = NULL;
+    const char *format = "json";
+    int compact = 0;
+    int intBlockIds = 0;
+    const char *compress = NULL;
+    bool binary;
+    static const char *kwlist[] = {"dest", "format", "compact", "int_block_ids", "compress", NULL};
+
+    if(!PyArg_ParseTupleAndKeywords(args, kwargs, "O|sppz", const_cast<char **>(kwlist),
+                                    &dest, &format, &compact, &intBlockIds, &compress)) {
+        return NULL;
+    }
+    if(!setFormat(format, binary) || !setCompress(compress)) return NULL;
+    compactNames = compact;
+    integerBlockIds = intBlockIds;
+
+    int fd;
+    bool ownsFd;
+    if(!openDest(dest, "write_json", fd, ownsFd)) {
+        resetOutputOptions();
+        return NULL;
+    }
+    return writeDest(fd, ownsFd, [](std::ostream &out) { streamParse(out); });
+}
+
+static PyObject *method_writeDotFile(PyObject *self, PyObject *args, PyObject *kwargs) {
+    PyObject *dest = NULL;
+    int clusters = 0;
+    const char *compress = NULL;
+    int collapse = 0;
+    static const char *kwlist[] = {"dest", "clusters", "compress", "collapse", NULL};
+
+    if(!PyArg_ParseTupleAndKeywords(args, kwargs, "O|pzp", const_cast<char **>(kwlist),
+                                    &dest, &clusters, &compress, &collapse)) {
+        return NULL;
+    }
+    if(!setCompress(compress)) return NULL;
+    dotClusters = clusters;
+    collapseBlocks = collapse;
+
+    int fd;
+    bool ownsFd;
+    if(!openDest(dest, "write_dot", fd, ownsFd)) {
+        resetOutputOptions();
+        return NULL;
+    }
+    return writeDest(fd, ownsFd, [](std::ostream &out) { streamDOT(out); });
+}
+
+static PyObject *method_getLayout(PyObject *self, PyObject *args, PyObject *kwargs) {
+    PyObject *function = NULL;
+    const char *format = "json";
+    int compact = 0;
+    int intBlockIds = 0;
+    const char *compress = NULL;
+    int collapse = 0;
+    bool binary;
+    std::vector<Dyninst::Address> entries;
+    static const char *kwlist[] = {"function", "format", "compact", "int_block_ids", "compress", "collapse", NULL};
+
+    if(!PyArg_ParseTupleAndKeywords(args, kwargs, "|Osppzp", const_cast<char **>(kwlist),
+                                    &function, &format, &compact, &intBlockIds, &compress, &collapse)) {
+        return NULL;
+    }
+    bool single = function && function != Py_None;
+    if(single && !parseEntries(function, entries)) return NULL;
+    if(!setFormat(format, binary) || !setCompress(compress)) return NULL;
+    compactNames = compact;
+    integerBlockIds = intBlockIds;
+    collapseBlocks = collapse;
+
+    return formatResult(single ? getLayoutFunctions(entries) : getLayout(), binary);
+}
+
+static PyObject *method_lookup(PyObject *self, PyObject *args) {
+    PyObject *arg = NULL;
+
+    if(!PyArg_ParseTuple(args, "O", &arg)) {
+        return NULL;
+    }
+    /* "K" would wrap negative and oversized numbers around silently */
+    unsigned long long addr = PyLong_AsUnsignedLongLong(arg);
+    if(PyErr_Occurred()) return NULL;
+    nlohmann::json res = lookupAddresses(std::vector<Dyninst::Address>(1, addr));
+    if(res.empty()) Py_RETURN_NONE;
+    PyConverter converter;
+    return converter.convert(res[0]);
+}
+
+static PyObject *method_lookupMany(PyObject *self, PyObject *args) {
+    PyObject *addrs = NULL;
+    std::vector<Dyninst::Address> list;
+
+    if(!PyArg_ParseTuple(args, "O", &addrs)) {
+        return NULL;
+    }
+    PyObject *seq = PySequence_Fast(addrs, "lookup_many expects a list of addresses");
+    if(!seq) return NULL;
+    for(Py_ssize_t i = 0; i < PySequence_Fast_GET_SIZE(seq); i++) {
+        list.push_back(PyLong_AsUnsignedLongLong(PySequence_Fast_GET_ITEM(seq, i)));
+        if(PyErr_Occurred()) {
+            Py_DECREF(seq);
+            return NULL;
+        }
+    }
+    Py_DECREF(seq);
+
+    PyConverter converter;
+    return converter.convert(lookupAddresses(list));
+}
+
+static PyObject *method_getCallGraph(PyObject *self, PyObject *args, PyObject *kwargs) {
+    const char *format = "json";
+    int compact = 0;
+    const char *compress = NULL;
+    bool binary;
+    static const char *kwlist[] = {"format", "compact", "compress", NULL};
+
+    if(!PyArg_ParseTupleAndKeywords(args, kwargs, "|spz", const_cast<char **>(kwlist),
+                                    &format, &compact, &compress)) {
+        return NULL;
+    }
+    if(!setFormat(format, binary) || !setCompress(compress)) return NULL;
+    compactNames = compact;
+
+    return formatResult(printCallGraph(), binary);
+}
+
+static PyObject *method_getCallGraphDot(PyObject *self, PyObject *args, PyObject *kwargs) {
+    const char *compress = NULL;
+    static const char *kwlist[] = {"compress", NULL};
+
+    if(!PyArg_ParseTupleAndKeywords(args, kwargs, "|z", const_cast<char **>(kwlist), &compress)) {
+        return NULL;
+    }
+    if(!setCompress(compress)) return NULL;
 
-    std::string ret = printSourceFiles().dump();
+    std::string ret = writeCallGraphDOT();
+    if(outputCompression != comp_none)
+        return compressResult([&](std::ostream &out) { out << ret; });
     return PyUnicode_FromString(ret.c_str());
 }
 
-static PyObject *method_getAssembly(PyObject *self, PyObject *args) {
+static PyObject *method_printSourceFiles(PyObject *self, PyObject *args, PyObject *kwargs) {
+    const char *format = "json";
+    bool binary;
+    static const char *kwlist[] = {"format", NULL};
+
+    if(!PyArg_ParseTupleAndKeywords(args, kwargs, "|s", const_cast<char **>(kwlist), &format)) {
+        return NULL;
+    }
+    if(!setFormat(format, binary)) return NULL;
+
+    return formatResult(printSourceFiles(), binary);
+}
+
+static PyObject *method_getAssembly(PyObject *self, PyObject *args, PyObject *kwargs) {
+    const char *format = "json";
+    int compact = 0;
+    int intBlockIds = 0;
+    const char *compress = NULL;
+    int collapse = 0;
+    bool binary;
+    static const char *kwlist[] = {"format", "compact", "int_block_ids", "compress", "collapse", NULL};
+
+    if(!PyArg_ParseTupleAndKeywords(args, kwargs, "|sppzp", const_cast<char **>(kwlist),
+                                    &format, &compact, &intBlockIds, &compress, &collapse)) {
+        return NULL;
+    }
+    if(!setFormat(format, binary) || !setCompress(compress)) return NULL;
+    compactNames = compact;
+    integerBlockIds = intBlockIds;
+    collapseBlocks = collapse;
+
+    return formatResult(getAssembly(), binary);
+}
+
+static PyObject *method_writeDot(PyObject *self, PyObject *args, PyObject *kwargs) {
+    PyObject *function = NULL;
+    int clusters = 0;
+    const char *compress = NULL;
+    int collapse = 0;
+    std::vector<Dyninst::Address> entries;
+    static const char *kwlist[] = {"function", "clusters", "compress", "collapse", NULL};
+
+    if(!PyArg_ParseTupleAndKeywords(args, kwargs, "|Opzp", const_cast<char **>(kwlist),
+                                    &function, &clusters, &compress, &collapse)) {
+        return NULL;
+    }
+    bool single = function && function != Py_None;
+    if(single && !parseEntries(function, entries)) return NULL;
+    if(!setCompress(compress)) return NULL;
+    dotClusters = clusters;
+    collapseBlocks = collapse;
 
-    std::string ret = getAssembly().dump();
+    std::string ret = single ? writeDOTFunctions(entries) : writeDOT();
+    if(outputCompression != comp_none)
+        return compressResult([&](std::ostream &out) { out << ret; });
+    resetOutputOptions();
     return PyUnicode_FromString(ret.c_str());
 }
 
-static PyObject *method_writeDot(PyObject *self, PyObject *args) {
-    std::string ret = writeDOT();
+/* Reads the after= cursor: None, an entry address, or the [entry, count]
+   pair a page gives as next */
+static bool parseCursor(PyObject *after, PageCursor &cursor) {
+    cursor.resume = after && after != Py_None;
+    if(!cursor.resume) return true;
+    if(PyLong_Check(after)) {
+        cursor.after = PyLong_AsUnsignedLongLong(after);
+        return !PyErr_Occurred();
+    }
+    PyObject *seq = PySequence_Fast(after, "after must be an address or an [address, count] pair");
+    if(!seq) return false;
+    bool ok = PySequence_Fast_GET_SIZE(seq) == 2;
+    if(ok) {
+        cursor.counted = true;
+        cursor.after = PyLong_AsUnsignedLongLong(PySequence_Fast_GET_ITEM(seq, 0));
+        cursor.count = PyErr_Occurred() ? 0 : PyLong_AsSize_t(PySequence_Fast_GET_ITEM(seq, 1));
+    } else {
+        PyErr_SetString(PyExc_TypeError, "after must be an address or an [address, count] pair");
+    }
+    Py_DECREF(seq);
+    return ok && !PyErr_Occurred();
+}
+
+static PyObject *method_listFunctions(PyObject *self, PyObject *args, PyObject *kwargs) {
+    const char *format = "json";
+    Py_ssize_t offset = 0;
+    Py_ssize_t limit = 0;
+    PyObject *after = NULL;
+    bool binary;
+    PageCursor cursor;
+    static const char *kwlist[] = {"format", "offset", "limit", "after", NULL};
+
+    if(!PyArg_ParseTupleAndKeywords(args, kwargs, "|snnO", const_cast<char **>(kwlist),
+                                    &format, &offset, &limit, &after)) {
+        return NULL;
+    }
+    if(offset < 0 || limit < 0) {
+        PyErr_SetString(PyExc_ValueError, "offset and limit must not be negative");
+        return NULL;
+    }
+    if(!parseCursor(after, cursor) || !setFormat(format, binary)) return NULL;
+
+    return formatResult(listFunctions(offset, limit, cursor), binary);
+}
+
+static PyObject *method_getFunctionPage(PyObject *self, PyObject *args, PyObject *kwargs) {
+    Py_ssize_t offset = 0;
+    Py_ssize_t limit = 100;
+    PyObject *after = NULL;
+    const char *format = "json";
+    int compact = 0;
+    int intBlockIds = 0;
+    bool binary;
+    PageCursor cursor;
+    static const char *kwlist[] = {"offset", "limit", "after", "format", "compact", "int_block_ids", NULL};
+
+    if(!PyArg_ParseTupleAndKeywords(args, kwargs, "|nnOspp", const_cast<char **>(kwlist),
+                                    &offset, &limit, &after, &format, &compact, &intBlockIds)) {
+        return NULL;
+    }
+    if(offset < 0 || limit < 0) {
+        PyErr_SetString(PyExc_ValueError, "offset and limit must not be negative");
+        return NULL;
+    }
+    if(!parseCursor(after, cursor) || !setFormat(format, binary)) return NULL;
+    compactNames = compact;
+    integerBlockIds = intBlockIds;
+
+    return formatResult(printParsePage(offset, limit, cursor), binary);
+}
+
+static const char *functionKwlist[] = {"functions", "format", "compact", "int_block_ids", NULL};
+
+static PyObject *method_getFunctionJson(PyObject *self, PyObject *args, PyObject *kwargs) {
+    PyObject *functions = NULL;
+    const char *format = "json";
+    int compact = 0;
+    int intBlockIds = 0;
+    bool binary;
+    std::vector<Dyninst::Address> entries;
+
+    if(!PyArg_ParseTupleAndKeywords(args, kwargs, "O|spp", const_cast<char **>(functionKwlist),
+                                    &functions, &format, &compact, &intBlockIds)) {
+        return NULL;
+    }
+    if(!parseEntries(functions, entries) || !setFormat(format, binary)) return NULL;
+    compactNames = compact;
+    integerBlockIds = intBlockIds;
+
+    return formatResult(printParseFunctions(entries), binary);
+}
+
+static PyObject *method_getFunctionAssembly(PyObject *self, PyObject *args, PyObject *kwargs) {
+    PyObject *functions = NULL;
+    const char *format = "json";
+    int compact = 0;
+    int intBlockIds = 0;
+    bool binary;
+    std::vector<Dyninst::Address> entries;
+
+    if(!PyArg_ParseTupleAndKeywords(args, kwargs, "O|spp", const_cast<char **>(functionKwlist),
+                                    &functions, &format, &compact, &intBlockIds)) {
+        return NULL;
+    }
+    if(!parseEntries(functions, entries) || !setFormat(format, binary)) return NULL;
+    compactNames = compact;
+    integerBlockIds = intBlockIds;
+
+    return formatResult(getAssemblyFunctions(entries), binary);
+}
+
+static PyObject *method_getFunctionDot(PyObject *self, PyObject *args) {
+    PyObject *functions = NULL;
+    std::vector<Dyninst::Address> entries;
+
+    if(!PyArg_ParseTuple(args, "O", &functions)) {
+        return NULL;
+    }
+    if(!parseEntries(functions, entries)) return NULL;
+
+    std::string ret = writeDOTFunctions(entries);
     return PyUnicode_FromString(ret.c_str());
 }
 
 
 static PyMethodDef SimpleOptMethods[] = {
-    {"decode", method_decode, METH_VARARGS, "Python interface for decode C function"},
-    {"get_json", method_printParse, METH_VARARGS, "return the json string"},
-    {"get_sourcefiles", method_printSourceFiles, METH_VARARGS, "return the source files"},
-    {"get_dot", method_writeDot, METH_VARARGS, "return the dot string"},
-    {"get_assembly", method_getAssembly, METH_VARARGS, "return the disassembly code"},
+    {"decode", (PyCFunction)(void (*)(void))method_decode, METH_VARARGS | METH_KEYWORDS,
+     "Python interface for decode C function. threads=N parses and scans on N threads (0 = all cores; "
+     "unset, the parse uses the OpenMP default and the scan one thread), "
+     "functions=[...] restricts the output, targeted=True parses only those functions and call_depth levels of callees, "
+     "cache_dir=... reuses results saved for the same binary"},
+    {"get_parse_time", method_getParseTime, METH_VARARGS, "return the seconds spent in the last CodeObject::parse"},
+    {"get_json", (PyCFunction)(void (*)(void))method_printParse, METH_VARARGS | METH_KEYWORDS,
+     "return the json string, or bytes for format='cbor'/'msgpack'; compact=True refers to names through a string table, "
+     "int_block_ids=True identifies blocks by index into block_names, compress='gzip'/'zstd' returns compressed bytes"},
+    {"write_json", (PyCFunction)(void (*)(void))method_writeJson, METH_VARARGS | METH_KEYWORDS,
+     "stream the json (or format='cbor'/'msgpack') to a path or file descriptor without building it in memory, "
+     "compressed with compress='gzip'/'zstd'"},
+    {"write_dot", (PyCFunction)(void (*)(void))method_writeDotFile, METH_VARARGS | METH_KEYWORDS,
+     "stream the dot graph to a path or file descriptor, compressed with compress='gzip'/'zstd'; "
+     "clusters= and collapse= as for get_dot"},
+    {"get_layout", (PyCFunction)(void (*)(void))method_getLayout, METH_VARARGS | METH_KEYWORDS,
+     "return a layered layout of every CFG (or of function=) with node boxes and edge polylines; "
+     "takes format=, compact=, int_block_ids=, compress= and collapse= like get_assembly"},
+    {"lookup", method_lookup, METH_VARARGS,
+     "return the block, every function holding it with its enclosing loops, and the source line of an address as a dict, or None"},
+    {"lookup_many", method_lookupMany, METH_VARARGS, "lookup for every address of a list, in one call"},
+    {"get_call_graph", (PyCFunction)(void (*)(void))method_getCallGraph, METH_VARARGS | METH_KEYWORDS,
+     "return the call graph: nodes, edges weighted by call sites, strongly connected components and "
+     "their topological order; takes format=, compact= and compress= like get_json"},
+    {"get_call_graph_dot", (PyCFunction)(void (*)(void))method_getCallGraphDot, METH_VARARGS | METH_KEYWORDS,
+     "return the call graph as dot, recursive components clustered; or bytes for compress='gzip'/'zstd'"},
+    {"get_parse_obj", method_getParseObj, METH_NOARGS, "return the get_json document as Python dicts and lists"},
+    {"get_sourcefiles_obj", method_getSourceFilesObj, METH_NOARGS, "return the source files as a Python list"},
+    {"get_assembly_obj", method_getAssemblyObj, METH_NOARGS, "return the disassembly code as Python dicts and lists"},
+    {"get_sourcefiles", (PyCFunction)(void (*)(void))method_printSourceFiles, METH_VARARGS | METH_KEYWORDS,
+     "return the source files, or bytes for format='cbor'/'msgpack'"},
+    {"get_dot", (PyCFunction)(void (*)(void))method_writeDot, METH_VARARGS | METH_KEYWORDS,
+     "return the dot string, or bytes for compress='gzip'/'zstd'; function= limits it to one function "
+     "(name or entry address), clusters=True puts each function in its own cluster subgraph, "
+     "collapse=True merges straight-line chains of blocks into superblocks"},
+    {"get_assembly", (PyCFunction)(void (*)(void))method_getAssembly, METH_VARARGS | METH_KEYWORDS,
+     "return the disassembly code, or bytes for format='cbor'/'msgpack'; compact=True refers to names through a string table, "
+     "int_block_ids=True identifies blocks by index into block_names, compress='gzip'/'zstd' returns compressed bytes, "
+     "collapse=True merges straight-line chains of blocks into superblocks"},
+    {"list_functions", (PyCFunction)(void (*)(void))method_listFunctions, METH_VARARGS | METH_KEYWORDS,
+     "return the name, entry address and size of every decoded function, or of the page given by offset=, limit= and after="},
+    {"get_function_page", (PyCFunction)(void (*)(void))method_getFunctionPage, METH_VARARGS | METH_KEYWORDS,
+     "return the get_json entries of one page of functions in entry address order, with the next cursor"},
+    {"get_function_json", (PyCFunction)(void (*)(void))method_getFunctionJson, METH_VARARGS | METH_KEYWORDS,
+     "return the get_json document for the functions given by entry address or name"},
+    {"get_function_dot", method_getFunctionDot, METH_VARARGS,
+     "return the dot string for the functions given by entry address or name"},
+    {"get_function_assembly", (PyCFunction)(void (*)(void))method_getFunctionAssembly, METH_VARARGS | METH_KEYWORDS,
+     "return the disassembly code for the functions given by entry address or name"},
     {NULL, NULL, 0, NULL}
 };
 
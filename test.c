@@ -8,6 +8,25 @@ int sub(int a, int b) {
     return a - b;
 }
 
+int is_odd(int n);
+
+int is_even(int n) {
+    return n == 0 ? 1 : is_odd(n - 1);
+}
+
+int is_odd(int n) {
+    return n == 0 ? 0 : is_even(n - 1);
+}
+
+int fact(int n) {
+    return n <= 1 ? 1 : n * fact(n - 1);
+}
+
+// Long enough that the output shortens it, like deep template instances
+int identity_with_a_name_long_enough_for_the_output_to_shorten_it_to_its_head_and_tail_around_an_ellipsis_like_deep_template_instantiations(int n) {
+    return n;
+}
+
 int main() {
     int a = 5;
     int b = 10;
@@ -25,6 +44,9 @@ int main() {
         }
     }
 
+    g += is_even(a) + fact(a);
+    g += identity_with_a_name_long_enough_for_the_output_to_shorten_it_to_its_head_and_tail_around_an_ellipsis_like_deep_template_instantiations(a);
+
     printf("%d", g);
 
     return 0;
@@ -0,0 +1,109 @@
+// Checks layoutGraph() on small graphs: edges flow down, cycles are cut,
+// layering is compacted and dummy nodes stay within LAYOUT_DUMMY_BUDGET.
+// It needs no Dyninst.
+//
+// make test_layout && ./test_layout
+
+#include <cstdio>
+#include <cstdlib>
+
+#include "layout.h"
+
+using namespace std;
+
+int failures = 0;
+
+void check(bool ok, const char *what) {
+  if (ok) return;
+  printf("FAIL: %s\n", what);
+  failures++;
+}
+
+LayoutGraph makeGraph(uint32_t n, const vector<pair<uint32_t, uint32_t> > &edges) {
+  LayoutGraph g;
+  g.width.assign(n, 30);
+  g.height.assign(n, 20);
+  g.edges = edges;
+  g.back.assign(edges.size(), false);
+  return g;
+}
+
+// Every edge but a self loop runs from a higher layer to a lower one, the
+// right way round for the edges marked back, and nodes of a layer do not
+// overlap
+void checkWellFormed(const LayoutGraph &g, const Layout &l, const char *what) {
+  for (size_t e = 0; e < g.edges.size(); e++) {
+    uint32_t v = g.edges[e].first, w = g.edges[e].second;
+    if (v == w) continue;
+    if (l.back[e]) swap(v, w);
+    check(l.layer[v] < l.layer[w], what);
+    check(l.points[e].size() >= 2, what);
+  }
+  for (uint32_t a = 0; a < g.width.size(); a++)
+    for (uint32_t b = a + 1; b < g.width.size(); b++)
+      if (l.layer[a] == l.layer[b])
+        check(l.x[a] + g.width[a] <= l.x[b] || l.x[b] + g.width[b] <= l.x[a], what);
+}
+
+void testCycle() {
+  // 0 -> 1 -> 2 -> 0 with no back edge given
+  LayoutGraph g = makeGraph(3, {{0, 1}, {1, 2}, {2, 0}});
+  Layout l = layoutGraph(g);
+  checkWellFormed(g, l, "cycle");
+  size_t cut = 0;
+  for (size_t e = 0; e < l.back.size(); e++) cut += l.back[e];
+  check(cut == 1, "cycle: exactly one edge reversed");
+}
+
+void testGivenBackEdge() {
+  // A loop 1 -> 2 -> 1 whose back edge is known
+  LayoutGraph g = makeGraph(4, {{0, 1}, {1, 2}, {2, 1}, {2, 3}});
+  g.back[2] = true;
+  Layout l = layoutGraph(g);
+  checkWellFormed(g, l, "back edge");
+  check(l.back[2] && !l.back[0] && !l.back[1] && !l.back[3], "back edge: only the given one");
+  // Drawn upwards: the polyline starts below where it ends
+  check(l.points[2].front().second > l.points[2].back().second, "back edge: points up");
+}
+
+void testCompaction() {
+  // 4 only feeds 3, at the bottom of the chain 0 -> 1 -> 2 -> 3; it belongs
+  // right above 3 rather than in the top layer
+  LayoutGraph g = makeGraph(5, {{0, 1}, {1, 2}, {2, 3}, {4, 3}});
+  Layout l = layoutGraph(g);
+  checkWellFormed(g, l, "compaction");
+  check(l.layer[4] == l.layer[3] - 1, "compaction: source pulled down");
+  check(l.points[3].size() == 2, "compaction: no dummy nodes left");
+}
+
+void testDummyBudget() {
+  // A chain with an edge from its head to every node: the dummy nodes
+  // needed for all edges grow with the square of the chain length
+  const uint32_t n = 300;
+  vector<pair<uint32_t, uint32_t> > edges;
+  for (uint32_t i = 0; i + 1 < n; i++) edges.push_back(make_pair(i, i + 1));
+  for (uint32_t i = 2; i < n; i++) edges.push_back(make_pair(0u, i));
+  LayoutGraph g = makeGraph(n, edges);
+  Layout l = layoutGraph(g);
+  checkWellFormed(g, l, "budget");
+
+  // Every dummy node adds two points to its edge
+  size_t dummies = 0;
+  for (auto &pts : l.points) dummies += (pts.size() - 2) / 2;
+  check(dummies <= LAYOUT_DUMMY_BUDGET * (n + edges.size()), "budget: dummies capped");
+  // Short edges are served first, so the chain itself is straight
+  for (uint32_t i = 0; i + 1 < n; i++) check(l.points[i].size() == 2, "budget: chain edges");
+}
+
+int main() {
+  testCycle();
+  testGivenBackEdge();
+  testCompaction();
+  testDummyBudget();
+  if (failures) {
+    printf("%d checks failed\n", failures);
+    return 1;
+  }
+  printf("layout checks passed\n");
+  return 0;
+}
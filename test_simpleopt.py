@@ -0,0 +1,406 @@
+# Behaviour checks for the simpleoptparser module, against the ./test binary
+# built from test.c. Run them with `make check` once the module is built:
+#   python3 setup.py build_ext --inplace
+import gzip
+import json
+import os
+import re
+import shutil
+import tempfile
+import unittest
+
+import simpleoptparser as sopt
+
+try:
+    import zstandard
+except ImportError:
+    zstandard = None
+
+BINARY = "./test"
+
+
+def decode(**kwargs):
+    if sopt.decode(BINARY, **kwargs) != 0:
+        raise RuntimeError("decoding %s failed" % BINARY)
+
+
+def outputs():
+    """Every whole-program output, as the module returns them"""
+    return {
+        "json": sopt.get_json(),
+        "dot": sopt.get_dot(),
+        "assembly": sopt.get_assembly(),
+        "sourcefiles": sopt.get_sourcefiles(),
+    }
+
+
+def variants():
+    """The outputs again in the other formats and options a cache hit must
+    also serve, plus the per-function and paged views"""
+    entry = json.loads(sopt.list_functions())[0]["entry"]
+    return {
+        "cbor": sopt.get_json(format="cbor"),
+        "compact": sopt.get_json(compact=True, int_block_ids=True),
+        "collapsed": sopt.get_assembly(collapse=True),
+        "layout": sopt.get_layout(),
+        "callgraph": sopt.get_call_graph(),
+        "functions": sopt.list_functions(),
+        "function": sopt.get_function_json(entry),
+        "page": sopt.get_function_page(limit=2),
+        "lookup": sopt.lookup(entry),
+        "parse_obj": sopt.get_parse_obj(),
+    }
+
+
+class ThreadsTest(unittest.TestCase):
+    def test_thread_count_does_not_change_output(self):
+        decode(threads=1)
+        serial = outputs()
+        for threads in (2, 4, 0):
+            decode(threads=threads)
+            self.assertEqual(outputs(), serial, "threads=%d" % threads)
+
+
+def without_block_numbers(doc):
+    """doc with every block id replaced by the block's start address. Block
+    numbers count every block decoded before, so they depend on what else
+    was decoded."""
+    starts = {}
+    for f in doc["functions"]:
+        for block in f["basicblocks"]:
+            starts[block["id"]] = "block at %#x" % block["start"]
+
+    def replace(value):
+        if isinstance(value, dict):
+            return {k: replace(v) for k, v in value.items()}
+        if isinstance(value, list):
+            return [replace(v) for v in value]
+        return starts.get(value, value) if isinstance(value, str) else value
+    return replace(doc)
+
+
+class TargetedTest(unittest.TestCase):
+    def test_call_depth_one_parses_main_and_its_callees(self):
+        decode()
+        graph = json.loads(sopt.get_call_graph())
+        nodes = graph["nodes"]
+        main = [i for i, n in enumerate(nodes) if n["name"] == "main"][0]
+        callees = {i: set() for i in range(len(nodes))}
+        for e in graph["edges"]:
+            callees[e["caller"]].add(e["callee"])
+        expected = {main} | callees[main]
+        full = {nodes[i]["entry"]: without_block_numbers(json.loads(sopt.get_function_json(nodes[i]["entry"])))
+                for i in expected}
+
+        decode(functions=["main"], targeted=True, call_depth=1)
+        entries = sorted(f["entry"] for f in json.loads(sopt.list_functions()))
+        self.assertEqual(entries, sorted(nodes[i]["entry"] for i in expected))
+        # Functions calling outside the set reach unparsed code, the others
+        # must come out as in the full decode
+        for i in expected:
+            if callees[i] <= expected:
+                entry = nodes[i]["entry"]
+                doc = without_block_numbers(json.loads(sopt.get_function_json(entry)))
+                self.assertEqual(doc, full[entry], nodes[i]["name"])
+
+
+
+class CacheTest(unittest.TestCase):
+    def setUp(self):
+        self.cache = tempfile.mkdtemp()
+
+    def tearDown(self):
+        shutil.rmtree(self.cache)
+
+    def test_cache_hit_gives_the_same_outputs(self):
+        decode()
+        fresh = dict(outputs(), **variants())
+
+        decode(cache_dir=self.cache)  # miss, stores the tables
+        self.assertTrue(os.listdir(self.cache))
+        decode(cache_dir=self.cache)  # hit
+        self.assertEqual(dict(outputs(), **variants()), fresh)
+
+    def test_cache_hit_streams(self):
+        decode()
+        expected = sopt.get_json()
+        decode(cache_dir=self.cache)
+        decode(cache_dir=self.cache)
+        path = os.path.join(self.cache, "out.json")
+        sopt.write_json(path)
+        with open(path) as f:
+            self.assertEqual(f.read(), expected)
+
+
+
+class BlockIdTest(unittest.TestCase):
+    @classmethod
+    def setUpClass(cls):
+        decode()
+        cls.plain = json.loads(sopt.get_json())
+
+    def blockIds(self, doc):
+        return [[block["id"] for block in f["basicblocks"]] for f in doc["functions"]]
+
+    def test_compact_names_resolve_to_the_plain_names(self):
+        doc = json.loads(sopt.get_json(compact=True))
+        strings = doc["strings"]
+        for f, plain in zip(doc["functions"], self.plain["functions"]):
+            self.assertEqual(strings[f["name"]], plain["name"])
+        for ids, plain in zip(self.blockIds(doc), self.blockIds(self.plain)):
+            # "<function>: B<n>" becomes [index of the function name, n]
+            self.assertEqual(["%s: B%d" % (strings[i], n) for i, n in ids], plain)
+
+    def test_shortened_function_names_prefix_their_block_names(self):
+        # test.c has a function whose name is too long to be written whole
+        long = [f for f in self.plain["functions"] if "..." in f["name"]]
+        self.assertTrue(long)
+        for f in long:
+            for block in f["basicblocks"]:
+                self.assertTrue(re.match(re.escape(f["name"]) + r": B\d+$", block["id"]), block["id"])
+
+    def test_integer_block_ids_index_block_names(self):
+        doc = json.loads(sopt.get_json(int_block_ids=True))
+        names = doc["block_names"]
+        for ids, plain in zip(self.blockIds(doc), self.blockIds(self.plain)):
+            self.assertEqual([names[i] for i in ids], plain)
+
+    def test_single_function_block_names_cover_its_blocks(self):
+        entry = self.plain["functions"][0]["entry"]
+        doc = json.loads(sopt.get_function_json(entry, int_block_ids=True))
+        ids = self.blockIds(doc)[0]
+        self.assertEqual(sorted(int(i) for i in doc["block_names"]), sorted(ids))
+
+
+
+class PagingTest(unittest.TestCase):
+    @classmethod
+    def setUpClass(cls):
+        decode()
+        cls.functions = json.loads(sopt.list_functions(limit=0, offset=0))
+        cls.entries = sorted(f["entry"] for f in cls.functions)
+
+    def test_pages_cover_every_function_once(self):
+        for limit in (1, 2, 3):
+            seen = []
+            page = json.loads(sopt.get_function_page(limit=limit))
+            while True:
+                self.assertEqual(page["total"], len(self.functions))
+                seen += [f["entry"] for f in page["functions"]]
+                if page["next"] is None:
+                    break
+                page = json.loads(sopt.get_function_page(limit=limit, after=page["next"]))
+            self.assertEqual(seen, self.entries, "limit=%d" % limit)
+
+    def test_cursor_forms(self):
+        first = self.entries[0]
+        above = [e for e in self.entries if e > first]
+        page = json.loads(sopt.list_functions(limit=0, after=first))
+        self.assertEqual([f["entry"] for f in page], above)
+        page = json.loads(sopt.list_functions(limit=0, after=[first, 1]))
+        self.assertEqual([f["entry"] for f in page], self.entries[1:])
+        with self.assertRaises(TypeError):
+            sopt.list_functions(after=[first])
+
+    def test_page_lines_match_the_whole_document(self):
+        whole = json.loads(sopt.get_json())
+        page = json.loads(sopt.get_function_page(limit=0))
+        self.assertEqual(page.get("lines"), whole.get("lines"))
+
+
+
+class SourceFileTest(unittest.TestCase):
+    def test_line_files_are_listed_source_files(self):
+        decode()
+        files = set(f["file"] for f in json.loads(sopt.get_sourcefiles()))
+        lines = json.loads(sopt.get_json())["lines"]
+        self.assertTrue(lines)
+        for line in lines:
+            self.assertIn(line["file"], files)
+
+
+
+class CompressionTest(unittest.TestCase):
+    @classmethod
+    def setUpClass(cls):
+        decode()
+
+    def test_gzip_round_trips(self):
+        self.assertEqual(gzip.decompress(sopt.get_json(compress="gzip")).decode(), sopt.get_json())
+        self.assertEqual(gzip.decompress(sopt.get_dot(compress="gzip")).decode(), sopt.get_dot())
+        self.assertEqual(gzip.decompress(sopt.get_json(format="cbor", compress="gzip")),
+                         sopt.get_json(format="cbor"))
+
+    @unittest.skipIf(zstandard is None, "zstandard is not installed")
+    def test_zstd_round_trips(self):
+        dctx = zstandard.ZstdDecompressor()
+        data = dctx.stream_reader(sopt.get_json(compress="zstd")).read()
+        self.assertEqual(data.decode(), sopt.get_json())
+
+    def test_compressed_file(self):
+        fd, path = tempfile.mkstemp(suffix=".json.gz")
+        os.close(fd)
+        try:
+            sopt.write_json(path, compress="gzip")
+            with gzip.open(path, "rt") as f:
+                self.assertEqual(f.read(), sopt.get_json())
+        finally:
+            os.remove(path)
+
+    def test_unknown_compression(self):
+        with self.assertRaises(ValueError):
+            sopt.get_json(compress="lzma")
+
+    def test_failed_call_leaves_no_options_behind(self):
+        expected = sopt.get_parse_obj()
+        for call in (sopt.get_json, sopt.get_assembly, sopt.get_layout, sopt.get_call_graph):
+            with self.assertRaises(ValueError):
+                call(format="cbor", compress="lzma")
+            self.assertEqual(sopt.get_parse_obj(), expected, call.__name__)
+
+
+
+class CallGraphTest(unittest.TestCase):
+    @classmethod
+    def setUpClass(cls):
+        decode()
+        cls.graph = json.loads(sopt.get_call_graph())
+        # test.c is built with g++, so its names may come mangled
+        cls.scc = {}
+        for node in cls.graph["nodes"]:
+            for name in ("is_even", "is_odd", "fact", "main"):
+                if node["name"] in (name, "_Z%d%si" % (len(name), name)):
+                    cls.scc[name] = node["scc"]
+
+    def test_recursion_forms_recursive_components(self):
+        sccs = self.graph["sccs"]
+        # is_even and is_odd call each other, fact calls itself
+        self.assertEqual(self.scc["is_even"], self.scc["is_odd"])
+        self.assertEqual(len(sccs[self.scc["is_even"]]["functions"]), 2)
+        self.assertTrue(sccs[self.scc["is_even"]]["recursive"])
+        self.assertEqual(len(sccs[self.scc["fact"]]["functions"]), 1)
+        self.assertTrue(sccs[self.scc["fact"]]["recursive"])
+        self.assertFalse(sccs[self.scc["main"]]["recursive"])
+
+    def test_order_puts_callers_first(self):
+        position = {c: i for i, c in enumerate(self.graph["order"])}
+        self.assertEqual(sorted(position), list(range(len(self.graph["sccs"]))))
+        nodes = self.graph["nodes"]
+        for edge in self.graph["edges"]:
+            caller, callee = nodes[edge["caller"]]["scc"], nodes[edge["callee"]]["scc"]
+            if caller != callee:
+                self.assertLess(position[caller], position[callee])
+
+    def test_recursive_components_are_clustered_in_dot(self):
+        dot = sopt.get_call_graph_dot()
+        self.assertIn("subgraph cluster_scc%d " % self.scc["is_even"], dot)
+        self.assertNotIn("subgraph cluster_scc%d " % self.scc["main"], dot)
+
+
+
+class CollapseTest(unittest.TestCase):
+    @classmethod
+    def setUpClass(cls):
+        decode()
+
+    def test_superblocks_hold_every_block(self):
+        plain = json.loads(sopt.get_assembly())
+        collapsed = json.loads(sopt.get_assembly(collapse=True))
+        members = set(b["id"] for sb in collapsed["blocks"] for b in sb["blocks"])
+        self.assertEqual(members, set(b["name"] for b in plain["blocks"]))
+        self.assertLessEqual(len(collapsed["blocks"]), len(plain["blocks"]))
+
+    def test_single_function_keeps_all_its_blocks(self):
+        for f in json.loads(sopt.list_functions()):
+            doc = json.loads(sopt.get_function_json(f["entry"]))
+            expected = sorted((b["start"], b["end"]) for b in doc["functions"][0]["basicblocks"])
+            dot = sopt.get_dot(function=f["entry"], collapse=True)
+            ranges = re.findall(r"0x([0-9a-f]+)-0x([0-9a-f]+)", " ".join(re.findall(r'ranges="([^"]*)"', dot)))
+            self.assertEqual(sorted((int(a, 16), int(b, 16)) for a, b in ranges), expected, f["name"])
+
+
+
+class FunctionViewTest(unittest.TestCase):
+    @classmethod
+    def setUpClass(cls):
+        decode()
+        cls.functions = json.loads(sopt.list_functions())
+
+    def test_single_function_dot_only_refers_to_its_blocks(self):
+        node = r'"(?:[^"\\]|\\.)*"'
+        for f in self.functions:
+            dot = sopt.get_dot(function=f["entry"])
+            declared = set(re.findall(r"^(%s) \[shape=box" % node, dot, re.M))
+            for edge in re.findall(r"^(%s) -> (%s) \[" % (node, node), dot, re.M):
+                self.assertLessEqual(set(edge), declared, f["name"])
+
+    def test_single_function_assembly_only_links_its_blocks(self):
+        for f in self.functions:
+            doc = json.loads(sopt.get_function_assembly(f["entry"], int_block_ids=True))
+            blocks = set(b["name"] for b in doc["blocks"])
+            for link in doc["links"]:
+                self.assertIn(link["source"], blocks, f["name"])
+                self.assertIn(link["target"], blocks, f["name"])
+                self.assertIn(str(link["source"]), doc["block_names"])
+
+
+
+class LayoutTest(unittest.TestCase):
+    @classmethod
+    def setUpClass(cls):
+        decode()
+
+    def test_edges_connect_their_nodes(self):
+        for f in json.loads(sopt.get_layout())["functions"]:
+            nodes = {n["id"]: n for n in f["nodes"]}
+            for e in f["edges"]:
+                source, target = nodes[e["from"]], nodes[e["to"]]
+                if e["from"] == e["to"]:
+                    continue
+                # Down from the bottom of the source, or up for a back edge
+                self.assertEqual(e["points"][0][1], source["y"] + source["height"] if not e["back"] else source["y"])
+                self.assertEqual(e["points"][-1][1], target["y"] if not e["back"] else target["y"] + target["height"])
+                if e["back"]:
+                    self.assertLess(target["layer"], source["layer"])
+                else:
+                    self.assertLess(source["layer"], target["layer"])
+
+
+
+class LookupTest(unittest.TestCase):
+    @classmethod
+    def setUpClass(cls):
+        decode()
+        cls.main = json.loads(sopt.get_function_json("main"))["functions"][0]
+
+    def test_entry_maps_back_to_its_function(self):
+        info = sopt.lookup(self.main["entry"])
+        self.assertLessEqual(info["block_start"], info["address"])
+        self.assertLess(info["address"], info["block_end"])
+        owners = [(f["name"], f["entry"]) for f in info["functions"]]
+        self.assertIn((self.main["name"], self.main["entry"]), owners)
+
+    def test_nested_loop_block_lists_both_loops(self):
+        outer = self.main["loops"][0]
+        inner = outer["loops"][0]
+        start = {b["id"]: b["start"] for b in self.main["basicblocks"]}[inner["blocks"][0]]
+        info = sopt.lookup(start)
+        loops = [f["loops"] for f in info["functions"] if f["entry"] == self.main["entry"]][0]
+        self.assertEqual(loops, [outer["name"], inner["name"]])
+
+    def test_lookup_many_matches_lookup(self):
+        addrs = [self.main["entry"], 0, self.main["basicblocks"][-1]["start"]]
+        self.assertEqual(sopt.lookup_many(addrs), [sopt.lookup(a) for a in addrs])
+
+    def test_bad_addresses(self):
+        self.assertIsNone(sopt.lookup(0))
+        with self.assertRaises(OverflowError):
+            sopt.lookup(-1)
+        with self.assertRaises(OverflowError):
+            sopt.lookup(1 << 64)
+        with self.assertRaises(TypeError):
+            sopt.lookup("main")
+
+
+if __name__ == "__main__":
+    unittest.main()